@@ -0,0 +1,167 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chain.h"
+#include "macros.h"
+#include "main.h"
+#include "memlock.h"
+#include "misc.h"
+
+//
+// something that isn't silence and doesn't repeat every block
+//
+static void
+fill_block(char *p, size_t sz, unsigned long long pos)
+{
+	for (size_t i = 0; i < sz; i++)
+		p[i] = (char)((pos+i)*2654435761u >> 13);
+}
+
+bool
+bench_chain(const struct bench_input *in,
+            struct buf *output,
+            struct bench_result *out)
+{
+	struct fmt fmt = in->fmt;
+	struct buf data = {0};
+	struct buf tmp = {0};
+	struct plugin_stats before[MAX_PLUGINS];
+	uint32_t rng = in->seed ?: 1;
+	unsigned int maxblock = in->block_frames ?: BENCH_RANDOM_BLOCK_MAX;
+	char *block;
+	unsigned long long pos = 0;
+
+	*out = (struct bench_result){0};
+
+	// (quietly, chain_set_format() would complain about it)
+	for (unsigned int i = 0; i < plugins_cnt; i++)
+		buf_clear(&plugins[i].buf);
+
+	if (!chain_set_format(&fmt))
+		return false;
+
+	block = malloc(fmt_frames2bytes(&fmt, maxblock));
+	if (block == NULL) {
+		perror("malloc");
+		return false;
+	}
+
+	for (unsigned int i = 0; i < plugins_cnt; i++)
+		before[i] = plugins[i].stats;
+
+	while (pos < in->frames) {
+		unsigned int n = in->block_frames ?: 1+xorshift32(&rng)%BENCH_RANDOM_BLOCK_MAX;
+		size_t sz, carry = 0;
+		uint64_t t0;
+		uint32_t f0;
+
+		n = MIN((unsigned long long)n, in->frames-pos);
+		sz = fmt_frames2bytes(&fmt, n);
+
+		fill_block(block, sz, fmt_frames2bytes(&fmt, 1)*pos);
+
+		chain_prepare_input(&data, sz);
+		memcpy(data.p, block, sz);
+		buf_register_append(&data, sz);
+
+		f0 = memlock_faults();
+		t0 = now_ns();
+		chain_process(&fmt, &data, &tmp, NULL);
+		out->ns += now_ns()-t0;
+		out->faults += memlock_faults()-f0;
+
+		out->frames_in += n;
+		out->frames_out += fmt_bytes2frames(&fmt, data.sz);
+
+		if (output != NULL)
+			buf_append(output, data.p, data.sz);
+
+		for (unsigned int i = 0; i < plugins_cnt; i++)
+			carry += plugins[i].buf.sz;
+		out->carry_max = MAX(out->carry_max, carry);
+
+		pos += n;
+	}
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		out->calls += plugins[i].stats.calls-before[i].calls;
+		out->copy_bytes += plugins[i].stats.copy_bytes-before[i].copy_bytes;
+	}
+
+	free(block);
+	buf_free(&data);
+	buf_free(&tmp);
+
+	return true;
+}
+
+static void
+print_cost(FILE *f, const char *name, double audio_s, unsigned long long frames,
+           unsigned long long calls, unsigned long long ns)
+{
+	double rtf = ns/1e9/audio_s;
+
+	fprintf(f, "%-32s %10.2f %10.1f %10.5f %10.1fx\n",
+	    name,
+	    frames ? (double)ns/frames : 0.0,
+	    calls/audio_s,
+	    rtf,
+	    rtf > 0 ? 1/rtf : 0.0);
+}
+
+bool
+bench_plugins(const struct bench_input *in, FILE *f)
+{
+	struct plugin_stats before[MAX_PLUGINS];
+	struct bench_result r;
+	double audio_s = (double)in->frames/in->fmt.rate;
+	unsigned long long chain_calls = 0;
+
+	for (unsigned int i = 0; i < plugins_cnt; i++)
+		before[i] = plugins[i].stats;
+
+	if (!bench_chain(in, NULL, &r))
+		return false;
+
+	fprintf(f, "format: %d Hz, %d bit, %d ch, %.1f s of audio in blocks of %u frames\n",
+	    in->fmt.rate, in->fmt.bps, in->fmt.ch, audio_s, in->block_frames);
+	fprintf(f, "%-32s %10s %10s %10s %11s\n",
+	    "", "ns/frame", "calls/s", "rtf", "realtime");
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		struct plugin *pl = &plugins[i];
+		char name[64];
+
+		snprintf(name, sizeof(name), "[%u] %s:%d", i,
+		    superbasename(pl->opts.path), pl->opts.module_idx);
+
+		if (pl->skip) {
+			fprintf(f, "%-32s (skipped, format not supported)\n", name);
+			continue;
+		}
+
+		// ns/frame is per frame given to ModifySamples(), which can be
+		//  more or less than went in if an earlier plugin stretched
+		print_cost(f, name, audio_s,
+		    pl->stats.frames_in-before[i].frames_in,
+		    pl->stats.calls-before[i].calls,
+		    pl->stats.ns-before[i].ns);
+
+		// (included in the line above)
+		if (pl->rs != NULL)
+			print_cost(f, "  resampler", audio_s,
+			    pl->stats.frames_in-before[i].frames_in,
+			    pl->stats.calls-before[i].calls,
+			    pl->stats.resample_ns-before[i].resample_ns);
+
+		chain_calls += pl->stats.calls-before[i].calls;
+	}
+
+	print_cost(f, "chain", audio_s, r.frames_in, chain_calls, r.ns);
+	fprintf(f, "page faults: %llu\n", r.faults);
+
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "buf.h"
+#include "fmt.h"
+
+#define BENCH_RANDOM_BLOCK_MAX 4096
+
+struct bench_input {
+	struct fmt fmt;
+	unsigned long long frames;
+	unsigned int block_frames; // 0 = random sizes from 1 to BENCH_RANDOM_BLOCK_MAX
+	uint32_t seed; // for the random sizes
+};
+
+struct bench_result {
+	unsigned long long ns; // spent in chain_process()
+	unsigned long long frames_in;
+	unsigned long long frames_out;
+
+	// summed over all the plugins
+	unsigned long long calls;
+	unsigned long long copy_bytes;
+
+	// most data buffered by the plugins after any block
+	size_t carry_max;
+
+	// page faults of the process during chain_process()
+	unsigned long long faults;
+};
+
+//
+// push in->frames frames of synthetic audio through plugins[] like the
+//  processing thread would. the input is the same whatever the block sizes
+// any data the plugins had buffered is thrown out first
+// if output isn't NULL, everything that comes out is appended to it
+//
+bool
+bench_chain(const struct bench_input *in,
+            struct buf *output,
+            struct bench_result *out);
+
+//
+// bench_chain() once and print what each plugin and the whole chain cost:
+//  ns per frame, ModifySamples() calls per second of audio and the real-time
+//  factor (processing time / audio time)
+//
+bool
+bench_plugins(const struct bench_input *in, FILE *f);
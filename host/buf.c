@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "macros.h"
+#include "memlock.h"
 
 void
 buf_prepare_capacity(struct buf *self, size_t req)
@@ -27,10 +28,14 @@ buf_prepare_capacity(struct buf *self, size_t req)
 	while (newcap < req)
 		newcap *= 2;
 
+	memlock_unlock(realp, realcap);
 	newp = realloc(realp, newcap);
 	if U (newp == NULL)
 		assert(!"buf_prepare_append: realloc");
 
+	// (all of it, realloc() may have moved it)
+	memlock_region(newp, newcap);
+
 	self->p = newp+self->res;
 	self->cap = newcap-self->res;
 }
@@ -72,8 +77,10 @@ buf_clear(struct buf *self)
 void
 buf_free(struct buf *self)
 {
-	if (self->p != NULL)
+	if (self->p != NULL) {
+		memlock_unlock(self->p-self->res, self->cap+self->res);
 		free(self->p-self->res); // free the original pointer
+	}
 
 	*self = (struct buf){0};
 }
@@ -0,0 +1,409 @@
+#include "chain.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "conv.h"
+#include "flight.h"
+#include "macros.h"
+#include "main.h"
+#include "misc.h"
+#include "resample.h"
+
+_Static_assert(MAX_PLUGINS <= FLIGHT_MAX_PLUGINS, "flight records are too small for MAX_PLUGINS");
+
+//
+// format adapters: a plugin that doesn't support the bit depth but would
+//  support another one runs at that one, with the data converted in front
+//  of it (conv.c). the depths are picked for the fewest conversions over the
+//  whole chain, including the one back at the end, then for the least
+//  narrowing
+//
+
+#define DEPTH_IDX(bps) ((bps)/8-1)
+#define DEPTH_BPS(idx) (((idx)+1)*8)
+#define DEPTHS 4
+
+#define ADAPT_CONV_COST 1000
+#define ADAPT_INF (INT_MAX/2)
+
+//
+// which bit depths the plugin could run at, as bits by DEPTH_IDX()
+//
+static unsigned int
+supported_depths(struct plugin *pl, const struct fmt *fmt)
+{
+	unsigned int depths = 0;
+
+	for (int d = 0; d < DEPTHS; d++) {
+		struct fmt f = *fmt;
+		f.bps = DEPTH_BPS(d);
+		if (plugin_supports_format(pl, &f) == NULL)
+			depths |= 1u<<d;
+	}
+
+	return depths;
+}
+
+static void
+plan_adapters(const struct fmt *fmt, const unsigned int *depths)
+{
+	const int in = DEPTH_IDX(fmt->bps);
+	int cost[DEPTHS];
+	signed char from[MAX_PLUGINS][DEPTHS];
+	int best = in, last = -1;
+	int cur = fmt->bps, conversions = 0;
+
+	for (int d = 0; d < DEPTHS; d++)
+		cost[d] = (d == in) ? 0 : ADAPT_INF;
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		int next[DEPTHS];
+
+		if (plugins[i].skip)
+			continue;
+
+		for (int d = 0; d < DEPTHS; d++) {
+			next[d] = ADAPT_INF;
+			if (!(depths[i] & (1u<<d)))
+				continue;
+			for (int p = 0; p < DEPTHS; p++) {
+				int c = cost[p] + (p != d)*ADAPT_CONV_COST + MAX(in-d, 0);
+				if (c < next[d]) {
+					next[d] = c;
+					from[i][d] = p;
+				}
+			}
+		}
+
+		memcpy(cost, next, sizeof(cost));
+		last = i;
+	}
+
+	if (last == -1)
+		return;
+
+	for (int d = 0; d < DEPTHS; d++) {
+		if (cost[d] + (d != in)*ADAPT_CONV_COST <
+		    cost[best] + (best != in)*ADAPT_CONV_COST)
+			best = d;
+	}
+
+	// walk it back
+	for (int i = last, d = best; i >= 0; i--) {
+		if (plugins[i].skip)
+			continue;
+		plugins[i].bps = DEPTH_BPS(d);
+		d = from[i][d];
+	}
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		if (plugins[i].skip)
+			continue;
+		if (plugins[i].bps != fmt->bps)
+			fprintf(stderr, "%s runs at %d bit instead of %d bit\n",
+			    superbasename(plugins[i].opts.path),
+			    plugins[i].bps, fmt->bps);
+		if (plugins[i].bps != cur)
+			conversions++;
+		cur = plugins[i].bps;
+	}
+	if (DEPTH_BPS(best) != fmt->bps)
+		conversions++;
+
+	if (conversions > 0)
+		fprintf(stderr, "format adapters: %d bit depth conversions per block\n",
+		    conversions);
+}
+
+//
+// the sample rate from rate= closest to the stream's that the plugin would
+//  run at, 0 if none. on a tie the higher one, so nothing gets band limited
+//  that doesn't have to be
+//
+static int
+pick_rate(struct plugin *pl, const struct fmt *fmt)
+{
+	const char *p = pl->opts.rate;
+	int best = 0;
+
+	while (p != NULL && *p != '\0') {
+		char *end;
+		long rate = strtol(p, &end, 10);
+		struct fmt f = *fmt;
+
+		p = (*end == ',') ? end+1 : NULL;
+
+		if (rate <= 0 || rate > INT_MAX || rate == fmt->rate)
+			continue;
+
+		f.rate = rate;
+		if (plugin_supports_format(pl, &f) != NULL &&
+		    !(pl->opts.adapt && supported_depths(pl, &f) != 0))
+			continue;
+
+		if (best == 0 ||
+		    abs((int)rate-fmt->rate) < abs(best-fmt->rate) ||
+		    (abs((int)rate-fmt->rate) == abs(best-fmt->rate) && rate > best))
+			best = rate;
+	}
+
+	return best;
+}
+
+bool
+chain_set_format(const struct fmt *fmt)
+{
+	bool warn = false;
+	const char *what;
+	unsigned int depths[MAX_PLUGINS];
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		struct fmt pfmt = *fmt;
+
+		if (plugins[i].buf.sz != 0) {
+			plugins[i].buf.sz = 0;
+			warn = true;
+		}
+
+		//
+		// re-check compatibility
+		//
+		resample_free(&plugins[i]);
+		plugins[i].skip = false;
+		plugins[i].bps = fmt->bps;
+		plugins[i].rate = fmt->rate;
+		depths[i] = 1u<<DEPTH_IDX(fmt->bps);
+		what = plugin_supports_format(&plugins[i], &pfmt);
+
+		// might work at another sample rate
+		if (what != NULL && plugins[i].opts.resample) {
+			pfmt.rate = pick_rate(&plugins[i], fmt);
+			if (pfmt.rate != 0)
+				what = plugin_supports_format(&plugins[i], &pfmt);
+			else
+				pfmt.rate = fmt->rate;
+		}
+
+		// might work at another bit depth
+		if (what != NULL && plugins[i].opts.adapt) {
+			depths[i] = supported_depths(&plugins[i], &pfmt);
+			if (depths[i] != 0)
+				what = NULL;
+		}
+
+		if (what == NULL && pfmt.rate != fmt->rate &&
+		    !resample_setup(&plugins[i], fmt, pfmt.rate))
+			what = "sample rate";
+
+		if (what != NULL) {
+			if (plugins[i].opts.required) {
+				fprintf(stderr, "error: required plugin %s doesn't support this %s, exiting\n",
+				    superbasename(plugins[i].opts.path),
+				    what);
+				return false;
+			}
+			fprintf(stderr, "warning: disabling %s due to unsupported %s\n",
+			    superbasename(plugins[i].opts.path),
+			    what);
+			plugins[i].skip = true;
+		}
+	}
+	if (warn)
+		fprintf(stderr, "warning: threw out buffered data due to format change\n");
+
+	plan_adapters(fmt, depths);
+
+	return true;
+}
+
+//
+// the space the plugins from `from` on will want to prepend their buffered
+//  data with
+//
+static size_t
+reserve_from(unsigned int from)
+{
+	size_t restotal = 0;
+
+	for (unsigned int i = from; i < plugins_cnt; i++) {
+		if (!plugins[i].skip)
+			restotal += plugins[i].buf.sz;
+	}
+
+	return restotal;
+}
+
+void
+chain_prepare_input(struct buf *data, size_t sz)
+{
+	size_t restotal = reserve_from(0);
+
+	buf_clear(data);
+	buf_prepare_append(data, restotal+sz);
+	buf_set_reserved(data, restotal);
+}
+
+void
+chain_process(struct fmt *fmt, struct buf *data, struct buf *tmp, struct flight_host_rec *fr)
+{
+	int bps = fmt->bps;
+	int last = -1;
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		size_t oldtmpsz, oldres, resused;
+		struct fmt pfmt = *fmt;
+		uint64_t t0, t;
+		unsigned long long oldcopy;
+
+		if (plugins[i].skip)
+			continue;
+
+		oldcopy = plugins[i].stats.copy_bytes;
+
+		if U (plugins[i].bps != bps) {
+			conv_buf(data, tmp, plugins[i].bps, bps, reserve_from(i));
+			plugins[i].stats.copy_bytes += data->sz;
+			bps = plugins[i].bps;
+		}
+		pfmt.bps = bps;
+		last = i;
+
+		oldtmpsz = plugins[i].buf.sz;
+		oldres = data->res;
+
+		if (fr != NULL)
+			fr->plugins[i].frames_in = fmt_bytes2frames(&pfmt, data->sz);
+
+		t0 = now_ns();
+
+		procidx = i;
+		plugin_process(&plugins[i], &pfmt, data, tmp);
+
+		t = now_ns()-t0;
+		plugins[i].stats.ns += t;
+
+		if (fr != NULL) {
+			fr->plugins[i].duration_us = t/1000;
+			fr->plugins[i].frames_out = fmt_bytes2frames(&pfmt, data->sz);
+			fr->plugins[i].copy_bytes = plugins[i].stats.copy_bytes-oldcopy;
+		}
+
+		// (everything went into its buffer, which may have swapped the
+		//  reserve away along with it)
+		if (data->sz == 0)
+			break;
+
+		resused = oldres-data->res;
+
+		// plugin used either 0 reserved space OR the exact old
+		//  size of its tmp buffer
+D		assert(resused == 0 || resused == oldtmpsz);
+	}
+	procidx = -1;
+
+	// back to what came in
+	if U (bps != fmt->bps) {
+		conv_buf(data, tmp, fmt->bps, bps, 0);
+		plugins[last].stats.copy_bytes += data->sz;
+	}
+
+	if (fr != NULL) {
+		fr->bytes_out = data->sz;
+		for (unsigned int i = 0; i < plugins_cnt; i++)
+			fr->carry_bytes += plugins[i].buf.sz;
+	}
+}
+
+unsigned int
+chain_latency_frames(const struct fmt *fmt)
+{
+	unsigned int frames = 0;
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		struct plugin *pl = &plugins[i];
+
+		if (pl->skip)
+			continue;
+
+		frames += pl->buf.sz/((pl->bps/8)*fmt->ch);
+		frames += pl->rs_latency;
+		frames += (uint64_t)pl->opts.latency*fmt->rate/pl->rate;
+	}
+
+	return frames;
+}
+
+bool
+chain_keeps_silence(void)
+{
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		struct plugin *pl = &plugins[i];
+
+		if (pl->skip)
+			continue;
+
+		if (!pl->opts.keepsilence || !is_zero(pl->buf.p, pl->buf.sz))
+			return false;
+	}
+
+	return true;
+}
+
+bool
+chain_cacheable(void)
+{
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		if (plugins[i].skip)
+			continue;
+
+		if (plugins[i].opts.nocache || plugins[i].opts.randomize)
+			return false;
+	}
+
+	return true;
+}
+
+bool
+chain_inactive(void)
+{
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		if (!plugins[i].skip)
+			return false;
+	}
+
+	return true;
+}
+
+void
+chain_reset(void)
+{
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		buf_clear(&plugins[i].buf);
+		resample_reset(&plugins[i]);
+	}
+}
+
+#define FLUSH_BLOCK_FRAMES 4096
+
+void
+chain_flush(struct fmt *fmt, unsigned int frames, struct buf *data, struct buf *tmp)
+{
+	while (frames > 0) {
+		unsigned int n = MIN(frames, FLUSH_BLOCK_FRAMES);
+		size_t sz = fmt_frames2bytes(fmt, n);
+
+		chain_prepare_input(data, sz);
+		memset(data->p, 0, sz);
+		buf_register_append(data, sz);
+
+		chain_process(fmt, data, tmp, NULL);
+		buf_clear(data);
+
+		frames -= n;
+	}
+
+	chain_reset();
+}
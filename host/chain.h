@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "buf.h"
+#include "fmt.h"
+
+struct flight_host_rec;
+
+//
+// the plugin chain as a whole (plugins[] in main.h)
+//
+// used by the processing thread and the benchmarks, so it doesn't know about
+//  pipes or windows
+//
+
+//
+// re-check which plugins can handle the format and throw out any data they
+//  had buffered. false if a required plugin can't handle it
+// plugins that only can't handle the bit depth get a format adapter instead
+//  unless they have noadapt
+//
+bool
+chain_set_format(const struct fmt *fmt);
+
+//
+// get `data` ready for sz bytes of input, with reserved space in front of it
+//  for the data the plugins have buffered. the input goes to data->p, then
+//  call buf_register_append()
+//
+void
+chain_prepare_input(struct buf *data, size_t sz);
+
+//
+// run data through the chain. tmp is scratch space kept between calls
+// fr can be NULL
+//
+void
+chain_process(struct fmt *fmt, struct buf *data, struct buf *tmp, struct flight_host_rec *fr);
+
+//
+// how many frames of audio the chain is holding on to right now, at the
+//  stream's rate: what the plugins have buffered, the resamplers' delay and
+//  latency= for the dlls' own
+//
+unsigned int
+chain_latency_frames(const struct fmt *fmt);
+
+//
+// true if silence going in would come out as silence: every plugin that runs
+//  has keepsilence and has nothing but silence buffered. only means anything
+//  after silence has just come out of the chain
+//
+bool
+chain_keeps_silence(void);
+
+//
+// true if every plugin is skipped for the current format, so the chain
+//  gives back what it gets
+//
+bool
+chain_inactive(void);
+
+//
+// true if the same input always gives the same output: no plugin that runs
+//  has nocache or randomize
+//
+bool
+chain_cacheable(void);
+
+//
+// throw out the data the plugins have buffered, e.g. on a seek. the dlls
+//  keep whatever they have inside, see chain_flush()
+//
+void
+chain_reset(void);
+
+//
+// run `frames` frames of silence through the chain first so reverb tails
+//  and such die out, and throw away what comes out. then chain_reset()
+//
+void
+chain_flush(struct fmt *fmt, unsigned int frames, struct buf *data, struct buf *tmp);
@@ -0,0 +1,172 @@
+#include "conv.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "macros.h"
+
+//
+// everything goes through int32_t, and conv_loop() is inlined with constant
+//  bit depths so each pair gets its own loop without any switches in it
+//
+
+__attribute__((always_inline))
+static inline int32_t
+get_s32(const char *p, int bps)
+{
+	int16_t s16;
+	int32_t s32;
+
+	switch (bps) {
+	case 8:
+		return (int32_t)((uint32_t)(uint8_t)p[0] << 24);
+	case 16:
+		memcpy(&s16, p, 2);
+		return (int32_t)((uint32_t)(uint16_t)s16 << 16);
+	case 24:
+		return (int32_t)((uint32_t)(uint8_t)p[0] << 8 |
+		                 (uint32_t)(uint8_t)p[1] << 16 |
+		                 (uint32_t)(uint8_t)p[2] << 24);
+	default:
+		memcpy(&s32, p, 4);
+		return s32;
+	}
+}
+
+__attribute__((always_inline))
+static inline void
+put_s32(char *p, int bps, int32_t v)
+{
+	uint32_t u = (uint32_t)v;
+	uint16_t u16;
+
+	switch (bps) {
+	case 8:
+		p[0] = (char)(u >> 24);
+		break;
+	case 16:
+		u16 = (uint16_t)(u >> 16);
+		memcpy(p, &u16, 2);
+		break;
+	case 24:
+		p[0] = (char)(u >> 8);
+		p[1] = (char)(u >> 16);
+		p[2] = (char)(u >> 24);
+		break;
+	default:
+		memcpy(p, &u, 4);
+		break;
+	}
+}
+
+__attribute__((always_inline))
+static inline void
+conv_loop(char *dst, int dst_bps, const char *src, int src_bps, size_t samples)
+{
+	const size_t ds = dst_bps/8, ss = src_bps/8;
+
+	for (size_t i = 0; i < samples; i++)
+		put_s32(dst+i*ds, dst_bps, get_s32(src+i*ss, src_bps));
+}
+
+void
+conv_samples(char *dst, int dst_bps, const char *src, int src_bps, size_t samples)
+{
+#define CONV(d_, s_) \
+	if (dst_bps == d_ && src_bps == s_) { \
+		conv_loop(dst, d_, src, s_, samples); \
+		return; \
+	}
+
+	CONV(16, 24) CONV(16, 32) CONV(16, 8)
+	CONV(24, 16) CONV(24, 32) CONV(24, 8)
+	CONV(32, 16) CONV(32, 24) CONV(32, 8)
+	CONV(8, 16)  CONV(8, 24)  CONV(8, 32)
+
+#undef CONV
+
+	assert(dst_bps == src_bps);
+	memmove(dst, src, samples*(src_bps/8));
+}
+
+__attribute__((always_inline))
+static inline void
+to_float_loop(float *dst, const char *src, int src_bps, size_t samples)
+{
+	const size_t ss = src_bps/8;
+
+	for (size_t i = 0; i < samples; i++)
+		dst[i] = get_s32(src+i*ss, src_bps)*(1.0f/2147483648.0f);
+}
+
+__attribute__((always_inline))
+static inline void
+from_float_loop(char *dst, int dst_bps, const float *src, size_t samples)
+{
+	const size_t ds = dst_bps/8;
+
+	for (size_t i = 0; i < samples; i++) {
+		float v = src[i]*2147483648.0f;
+		int32_t s;
+
+		// (2147483648.0f isn't representable as int32_t)
+		if (v >= 2147483520.0f)
+			s = INT32_MAX;
+		else if (v <= -2147483648.0f)
+			s = INT32_MIN;
+		else
+			s = (int32_t)v;
+
+		put_s32(dst+i*ds, dst_bps, s);
+	}
+}
+
+void
+conv_to_float(float *dst, const char *src, int src_bps, size_t samples)
+{
+	switch (src_bps) {
+	case 8:  to_float_loop(dst, src, 8, samples); break;
+	case 16: to_float_loop(dst, src, 16, samples); break;
+	case 24: to_float_loop(dst, src, 24, samples); break;
+	default: to_float_loop(dst, src, 32, samples); break;
+	}
+}
+
+void
+conv_from_float(char *dst, int dst_bps, const float *src, size_t samples)
+{
+	switch (dst_bps) {
+	case 8:  from_float_loop(dst, 8, src, samples); break;
+	case 16: from_float_loop(dst, 16, src, samples); break;
+	case 24: from_float_loop(dst, 24, src, samples); break;
+	default: from_float_loop(dst, 32, src, samples); break;
+	}
+}
+
+void
+conv_buf(struct buf *data, struct buf *tmp, int dst_bps, int src_bps, size_t reserve)
+{
+	size_t samples = data->sz/(src_bps/8);
+	size_t sz = samples*(dst_bps/8);
+
+	buf_clear(tmp);
+	buf_prepare_append(tmp, reserve+sz);
+	buf_set_reserved(tmp, reserve);
+
+	conv_samples(tmp->p, dst_bps, data->p, src_bps, samples);
+
+	buf_set_size(tmp, sz);
+	buf_swap(data, tmp);
+}
+
+UNITTEST(conv) {
+	const int16_t in[4] = {0, 1, -1, -32768};
+	char wide[4*4];
+	int16_t out[4];
+
+	for (int bps = 24; bps <= 32; bps += 8) {
+		conv_samples(wide, bps, (const char *)in, 16, 4);
+		conv_samples((char *)out, 16, wide, bps, 4);
+		assert(memcmp(in, out, sizeof(in)) == 0);
+	}
+}
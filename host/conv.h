@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "buf.h"
+
+//
+// bit depth conversion for the format adapters (chain_set_format())
+//
+// samples are signed, the same as what deadbeef gives us. narrowing
+//  truncates, there's no dither
+//
+
+void
+conv_samples(char *dst, int dst_bps, const char *src, int src_bps, size_t samples);
+
+//
+// to and from floats in [-1, 1) for the resampler. from_float clips
+//
+void
+conv_to_float(float *dst, const char *src, int src_bps, size_t samples);
+
+void
+conv_from_float(char *dst, int dst_bps, const float *src, size_t samples);
+
+//
+// convert all of data to dst_bps through tmp, leaving `reserve` bytes of
+//  reserved space in front of it (see chain_prepare_input())
+//
+void
+conv_buf(struct buf *data, struct buf *tmp, int dst_bps, int src_bps, size_t reserve);
@@ -0,0 +1,105 @@
+#include "flight.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "macros.h"
+#include "memlock.h"
+#include "misc.h"
+#include "shm.h"
+
+struct flightdata *flight = NULL;
+
+// true if the plugin created the file and will dump it for us
+static bool flight_shared = false;
+
+// -----------------------------------------------------------------------------
+
+bool
+flight_init(void)
+{
+	const char *name = getenv("DDW_FLIGHT_NAME");
+
+	if (name != NULL) {
+		flight = shmnew(name, sizeof(struct flightdata));
+		if (flight != NULL && memcmp(flight->magic, FLIGHT_MAGIC, sizeof(flight->magic)) != 0) {
+			fprintf(stderr, "warning: flight recorder file has the wrong version, not using it\n");
+			flight = NULL;
+		}
+		flight_shared = (flight != NULL);
+	}
+
+	// keep records even without the plugin so they can be dumped on abort
+	if (flight == NULL) {
+		flight = VirtualAlloc(NULL, sizeof(struct flightdata),
+		    MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+		if (flight == NULL) {
+			PrintError("VirtualAlloc");
+			return false;
+		}
+		memcpy(flight->magic, FLIGHT_MAGIC, sizeof(flight->magic));
+	}
+
+	flight->host_starts++;
+
+	// (written after every block)
+	memlock_region(flight, sizeof(struct flightdata));
+
+	return true;
+}
+
+struct flight_host_rec *
+flight_host_begin(void)
+{
+	uint32_t seq = flight->host_seq;
+	struct flight_host_rec *r = &flight->host[seq % FLIGHT_RECORDS];
+
+	*r = (struct flight_host_rec){
+		.time_ns = now_ns(),
+		.seq = seq,
+		.faults = FLIGHT_NO_FAULTS,
+	};
+
+	return r;
+}
+
+void
+flight_host_commit(void)
+{
+	flight->host_seq++;
+}
+
+void
+flight_dump(const char *why)
+{
+	static bool dumping = false;
+	char path[MAX_PATH];
+	DWORD len;
+	FILE *f;
+
+	if (flight == NULL || flight_shared || dumping)
+		return;
+	dumping = true;
+
+	len = GetTempPath(sizeof(path), path);
+	if (len == 0 || len >= sizeof(path))
+		len = 0;
+	snprintf(path+len, sizeof(path)-len, "ddw_flight.%lu.txt",
+	    (unsigned long)GetCurrentProcessId());
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		perror("flight_dump: fopen");
+		return;
+	}
+
+	fprintf(f, "# %s\n", why);
+	flight_print(f, flight);
+	fclose(f);
+
+	fprintf(stderr, "flight recorder dumped to %s\n", path);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "../plugin/flightdata.h"
+
+extern struct flightdata *flight;
+
+bool
+flight_init(void);
+
+//
+// get the record for the next block. it's zeroed and has the seq and time
+//  filled in. call flight_host_commit() when done
+//
+struct flight_host_rec *
+flight_host_begin(void);
+
+void
+flight_host_commit(void);
+
+//
+// called before aborting. writes the records to a file if the plugin isn't
+//  going to do it
+//
+void
+flight_dump(const char *why);
@@ -0,0 +1,205 @@
+#include "log.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "macros.h"
+#include "misc.h"
+
+#define LOG_RING_SIZE 1024 // must be a power of two
+#define LOG_POLL_MS 50
+
+struct logrec {
+	const char *name;
+	int type;
+	int a, b, c, d;
+};
+
+//
+// single producer (the processing thread), single consumer (log thread)
+// head is only written by the producer and tail only by the consumer
+//
+static struct logrec ring[LOG_RING_SIZE];
+static _Atomic unsigned int head;
+static _Atomic unsigned int tail;
+static _Atomic unsigned int dropped;
+
+static _Atomic int stopping;
+static HANDLE logthread = NULL;
+
+// -----------------------------------------------------------------------------
+
+static int
+format_rec(char *buf, size_t bufsz, const struct logrec *r)
+{
+	switch (r->type) {
+	case LOG_NOT_EDIBLE:
+		return snprintf(buf, bufsz, "[%s] incoming %d frames not yet edible, adding to buffer\n",
+		    superbasename(r->name), r->a);
+	case LOG_TOOK_BUFFERED:
+		return snprintf(buf, bufsz, "[%s] took %d frames from temp. buffer, data is now %d frames\n",
+		    superbasename(r->name), r->a, r->b);
+	case LOG_LEFTOVER:
+		return snprintf(buf, bufsz, "[%s] leftover frames after processing: %d\n",
+		    superbasename(r->name), r->a);
+	case LOG_MODIFYSAMPLES:
+		return snprintf(buf, bufsz, "[%s] ModifySamples %d -> %d\n",
+		    superbasename(r->name), r->a, r->b);
+	case LOG_BAD_RETURN:
+		return snprintf(buf, bufsz, "warning: ModifySamples() for plugin %s returned %d\n",
+		    superbasename(r->name), r->a);
+	case LOG_OVERSTRETCH:
+		return snprintf(buf, bufsz, "warning: %.1fx stretch (%d -> %d) by plugin %s is above %s %d\n",
+		    (float)r->b / (float)r->a,
+		    r->a, r->b,
+		    superbasename(r->name),
+		    (r->d) ?
+		        "MAX_STRETCH_FACTOR" :
+		        "its allowed stretch factor",
+		    r->c);
+	case LOG_TMPBUF_LARGE:
+		return snprintf(buf, bufsz, "warning: temp. buffer of plugin %s exceeds one second. is it working properly?\n",
+		    superbasename(r->name));
+	case LOG_RANDOMIZED:
+		return snprintf(buf, bufsz, "[%s] pfm=%d pmf=%d pMf=%d\n",
+		    superbasename(r->name), r->a, r->b, r->c);
+	case LOG_SPLIT_MISMATCH:
+		return snprintf(buf, bufsz, "warning: split instances of plugin %s returned %d to %d frames, keeping %d\n",
+		    superbasename(r->name), r->a, r->b, r->a);
+	case LOG_STRETCH_MOVE:
+		return snprintf(buf, bufsz, "[%s] stretched into the input, moving the other %d frames aside\n",
+		    superbasename(r->name), r->a);
+	case LOG_NOSTRETCH:
+		return snprintf(buf, bufsz, "[%s] no stretch in %d blocks, processing without guard copies\n",
+		    superbasename(r->name), r->a);
+	case LOG_STRETCH_AGAIN:
+		return snprintf(buf, bufsz, "warning: plugin %s stretched after %d blocks without, some input may have been lost (it shouldn't have autostretch=)\n",
+		    superbasename(r->name), r->a);
+	default:
+		return snprintf(buf, bufsz, "log: unknown message type %d\n", r->type);
+	}
+}
+
+//
+// format everything currently in the ring and write it out in as few writes
+//  as possible
+//
+static void
+log_drain(void)
+{
+	char out[4096];
+	size_t outsz = 0;
+	unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+	unsigned int h = atomic_load_explicit(&head, memory_order_acquire);
+	unsigned int d;
+
+	for (; t != h; t++) {
+		char line[256];
+		int len = format_rec(line, sizeof(line), &ring[t % LOG_RING_SIZE]);
+
+		if (len < 0)
+			continue;
+		if ((size_t)len >= sizeof(line))
+			len = sizeof(line)-1;
+
+		if (outsz+len > sizeof(out)) {
+			write_full(2, out, outsz);
+			outsz = 0;
+		}
+		memcpy(out+outsz, line, len);
+		outsz += len;
+	}
+	atomic_store_explicit(&tail, t, memory_order_release);
+
+	if (outsz != 0)
+		write_full(2, out, outsz);
+
+	d = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+	if U (d != 0)
+		fprintf(stderr, "warning: log buffer was full, dropped %u messages\n", d);
+}
+
+static DWORD WINAPI
+log_thread_main(void *ud)
+{
+	(void)ud;
+
+	while (!atomic_load_explicit(&stopping, memory_order_relaxed)) {
+		log_drain();
+		Sleep(LOG_POLL_MS);
+	}
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+log_post(enum log_type type, const char *name, int a, int b, int c, int d)
+{
+	unsigned int h = atomic_load_explicit(&head, memory_order_relaxed);
+	unsigned int t = atomic_load_explicit(&tail, memory_order_acquire);
+	struct logrec rec = {
+		.name = name,
+		.type = type,
+		.a = a, .b = b, .c = c, .d = d,
+	};
+
+	// no log thread (not started or already stopped): print it right away
+	if U (logthread == NULL) {
+		char line[256];
+		int len = format_rec(line, sizeof(line), &rec);
+		if (len > 0)
+			write_full(2, line, MIN((size_t)len, sizeof(line)-1));
+		return;
+	}
+
+	if U (h-t >= LOG_RING_SIZE) {
+		atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	ring[h % LOG_RING_SIZE] = rec;
+	atomic_store_explicit(&head, h+1, memory_order_release);
+}
+
+bool
+log_init(void)
+{
+	if (logthread != NULL)
+		return true;
+
+	atomic_store(&stopping, 0);
+
+	logthread = CreateThread(NULL, 0, log_thread_main, NULL, 0, NULL);
+	if (logthread == NULL) {
+		PrintError("CreateThread");
+		return false;
+	}
+
+	SetThreadPriority(logthread, THREAD_PRIORITY_LOWEST);
+
+	return true;
+}
+
+void
+log_deinit(void)
+{
+	if (logthread == NULL)
+		return;
+
+	atomic_store(&stopping, 1);
+
+	if (WaitForSingleObject(logthread, 1000) == WAIT_OBJECT_0) {
+		CloseHandle(logthread);
+		logthread = NULL;
+		// print whatever came in after the last drain
+		log_drain();
+	} else {
+		fprintf(stderr, "warning: failed to join log thread in 1000ms\n");
+	}
+}
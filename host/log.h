@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+
+//
+// messages from the processing thread
+// they're appended to a ring buffer as fixed-size records and formatted by a
+//  low-priority thread, so tracing doesn't make the processing thread wait
+//  for stderr
+//
+enum log_type {
+	LOG_NOT_EDIBLE,     // a = frames
+	LOG_TOOK_BUFFERED,  // a = frames from buffer, b = total frames
+	LOG_LEFTOVER,       // a = frames
+	LOG_MODIFYSAMPLES,  // a = frames in, b = frames out
+	LOG_BAD_RETURN,     // a = ModifySamples() return value
+	LOG_OVERSTRETCH,    // a = frames in, b = frames out, c = allowed factor, d = may_stretch
+	LOG_TMPBUF_LARGE,   // (none)
+	LOG_RANDOMIZED,     // a = pfm, b = pmf, c = pMf
+	LOG_SPLIT_MISMATCH, // a = fewest frames out, b = most frames out
+	LOG_STRETCH_MOVE,   // a = frames
+	LOG_NOSTRETCH,      // a = blocks
+	LOG_STRETCH_AGAIN,  // a = blocks
+};
+
+//
+// name: plugin name for the message. must stay valid until the message is
+//  printed (plugin paths live until exit so they're fine)
+//
+void
+log_post(enum log_type type, const char *name, int a, int b, int c, int d);
+
+bool
+log_init(void);
+
+//
+// stops the log thread and prints what's left. also for the fatal paths, so
+//  the warnings leading up to an abort() aren't lost with it
+//
+void
+log_deinit(void);
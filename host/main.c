@@ -4,11 +4,18 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include "bench.h"
+#include "flight.h"
+#include "log.h"
 #include "macros.h"
+#include "memlock.h"
 #include "misc.h"
 #include "procmain.h"
+#include "render.h"
+#include "sched.h"
 #include "shm.h"
 #include "wndproc.h"
 
@@ -93,6 +100,51 @@ conf_thread_main(void *ud)
 	return 0;
 }
 
+//
+// --bench[=rate[,bits[,ch[,seconds[,block]]]]]
+//
+__attribute__((optimize("-Os")))
+static bool
+parse_bench_arg(const char *arg, struct bench_input *out)
+{
+	int rate = 44100, bits = 16, ch = 2, seconds = 10, block = 576;
+
+	if (arg[0] == '=') {
+		int rv = sscanf(arg+1, "%d,%d,%d,%d,%d", &rate, &bits, &ch, &seconds, &block);
+		if (rv < 1)
+			return false;
+	} else if (arg[0] != '\0') {
+		return false;
+	}
+
+	*out = (struct bench_input){
+		.fmt = {.rate = rate, .bps = bits, .ch = ch},
+		.frames = (unsigned long long)seconds*rate,
+		.block_frames = block,
+	};
+
+	return fmt_makes_sense(&out->fmt) && seconds > 0 && block > 0;
+}
+
+//
+// --render[=rate,bits,ch] (the format is only needed for raw input)
+//
+__attribute__((optimize("-Os")))
+static bool
+parse_render_arg(const char *arg, struct fmt *out, bool *have)
+{
+	*have = false;
+
+	if (arg[0] == '=') {
+		if (sscanf(arg+1, "%d,%d,%d", &out->rate, &out->bps, &out->ch) != 3)
+			return false;
+		*have = true;
+		return fmt_makes_sense(out);
+	}
+
+	return arg[0] == '\0';
+}
+
 __attribute__((optimize("-Os")))
 int
 main(int argc, char **argv)
@@ -101,6 +153,17 @@ main(int argc, char **argv)
 	HANDLE procthread = NULL;
 	int nul = -1;
 	int rv = 0;
+	int argi = 1;
+	enum {
+		MODE_PIPE,
+		MODE_BENCH,
+		MODE_RENDER,
+		MODE_RENDER_BATCH,
+	} mode = MODE_PIPE;
+	struct bench_input bench_in;
+	const char *render_in = NULL, *render_out = NULL;
+	struct fmt render_fmt;
+	bool render_fmt_given = false;
 
 	// disable newline conversion
 	_setmode(0, _O_BINARY);
@@ -155,11 +218,45 @@ D	fprintf(stderr, "ddw_host.exe: debug checks are enabled\n");
 
 	PeekMessage(&(MSG){0}, NULL, 0, 0, PM_NOREMOVE);
 
+	//
+	// --bench: run the plugins on synthetic audio in this process instead of
+	//  serving the pipe
+	// --render: same but with a file
+	// --render-batch: same but with the files read from the pipe
+	//
+
+	if (argc > 1 && strncmp(argv[1], "--bench", 7) == 0) {
+		if (!parse_bench_arg(argv[1]+7, &bench_in)) {
+			fprintf(stderr, "usage: ddw_host.exe --bench[=rate[,bits[,ch[,seconds[,block]]]]] plugin...\n");
+			goto err;
+		}
+		mode = MODE_BENCH;
+		argi = 2;
+	} else if (argc > 1 && strncmp(argv[1], "--render-batch", 14) == 0) {
+		if (!parse_render_arg(argv[1]+14, &render_fmt, &render_fmt_given)) {
+			fprintf(stderr, "usage: ddw_host.exe --render-batch[=rate,bits,ch] plugin...\n");
+			goto err;
+		}
+		mode = MODE_RENDER_BATCH;
+		argi = 2;
+	} else if (argc > 1 && strncmp(argv[1], "--render", 8) == 0) {
+		if (argc < 4 || !parse_render_arg(argv[1]+8, &render_fmt, &render_fmt_given)) {
+			fprintf(stderr, "usage: ddw_host.exe --render[=rate,bits,ch] input output plugin...\n");
+			goto err;
+		}
+		mode = MODE_RENDER;
+		render_in = argv[2];
+		render_out = argv[3];
+		argi = 4;
+	}
+
 	//
 	// open the shared memory file if DDW_SHM_NAME= is set
 	//
 
-	if (getenv("DDW_SHM_NAME") != NULL) {
+	if (mode != MODE_PIPE) {
+		// nothing to talk to
+	} else if (getenv("DDW_SHM_NAME") != NULL) {
 		shm = shmnew(getenv("DDW_SHM_NAME"), sizeof(struct shmdata));
 		if (shm == NULL) {
 			fprintf(stderr, "error: opening shm failed\n");
@@ -169,6 +266,18 @@ D	fprintf(stderr, "ddw_host.exe: debug checks are enabled\n");
 		fprintf(stderr, "warning: DDW_SHM_NAME not set\n");
 	}
 
+	//
+	// open the flight recorder (shared with the plugin if DDW_FLIGHT_NAME=
+	//  is set). with DDW_LOCK_MEMORY= it gets locked with everything else
+	//
+
+	memlock_setup_process();
+
+	if (!flight_init()) {
+		fprintf(stderr, "error: flight recorder setup failed\n");
+		goto err;
+	}
+
 	//
 	// create the "window" to receive winamp IPC messages
 	// https://stackoverflow.com/a/4081383
@@ -203,7 +312,7 @@ D	fprintf(stderr, "ddw_host.exe: debug checks are enabled\n");
 	// load plugins
 	//
 
-	for (int i = 1; i < argc; i++) {
+	for (int i = argi; i < argc; i++) {
 		if (!new_plugin(argv[i]))
 			goto err;
 	}
@@ -213,10 +322,64 @@ D	fprintf(stderr, "ddw_host.exe: debug checks are enabled\n");
 		goto err;
 	}
 
+	//
+	// start the log thread for messages from the processing thread
+	// if this fails, they're just printed directly
+	//
+
+	log_init();
+
+	// Config() only runs in the pipe mode. in the others nothing's waiting
+	//  for it, so the plugins are unloaded (and Quit()) at the end
+	if (mode != MODE_PIPE) {
+		for (unsigned int i = 0; i < plugins_cnt; i++)
+			plugins[i].didconf = -1;
+	}
+
+	if (mode == MODE_BENCH) {
+		FILE *f = fdopen(out_fd, "w");
+		if (f == NULL) {
+			perror("fdopen");
+			goto err;
+		}
+		out_fd = -1;
+
+		if (!bench_plugins(&bench_in, f))
+			rv = 1;
+
+		fclose(f);
+		goto out;
+	}
+
+	if (mode == MODE_RENDER) {
+		if (!render_file(render_in, render_out, render_fmt_given ? &render_fmt : NULL))
+			rv = 1;
+		goto out;
+	}
+
+	if (mode == MODE_RENDER_BATCH) {
+		FILE *in = fdopen(in_fd, "r");
+		FILE *out = fdopen(out_fd, "w");
+		if (in == NULL || out == NULL) {
+			perror("fdopen");
+			goto err;
+		}
+		in_fd = out_fd = -1;
+
+		if (!render_batch(in, out, render_fmt_given ? &render_fmt : NULL))
+			rv = 1;
+
+		fclose(in);
+		fclose(out);
+		goto out;
+	}
+
 	//
 	// start the processing thread
 	//
 
+	sched_setup_process();
+
 	procthread = CreateThread(NULL,
 	                          16*1024*1024,
 	                          process_thread_main,
@@ -276,13 +439,18 @@ out:
 		}
 	}
 
+	// (if procthread couldn't be joined, it may still be logging)
+	if (procthread == NULL)
+		log_deinit();
+
+	if (shm != NULL)
+		wndproc_print_summary();
+
 	while (plugins_cnt > 0) {
 		struct plugin *pl = &plugins[plugins_cnt-1];
 		// don't free it if we still haven't finished calling Config()
-		if (pl->didconf != 0) {
-			pl->module->Quit(pl->module);
-			FreeLibrary(pl->dll);
-		}
+		if (pl->didconf != 0)
+			unload_plugin(pl);
 		buf_free(&pl->buf);
 		plugins_cnt--;
 	}
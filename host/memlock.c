@@ -0,0 +1,128 @@
+#include "memlock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+
+#include "macros.h"
+#include "misc.h"
+
+// the smallest page size there is. touching every one of these touches
+//  every page whatever the real size
+#define MEMLOCK_PAGE 4096
+
+// how much of the processing thread's stack to prefault. the dlls' own
+//  ModifySamples() goes on it too, so it's more than ddw needs itself
+#define MEMLOCK_STACK (256*1024)
+
+// VirtualLock() can only lock as much as the minimum working set allows
+#define MEMLOCK_WS_MIN (64*1024*1024)
+#define MEMLOCK_WS_MAX (256*1024*1024)
+
+bool memlock_on = false;
+bool memlock_count = false;
+
+// only complain once, this can fail on every buffer
+static bool lock_failed = false;
+
+// -----------------------------------------------------------------------------
+
+static bool
+getenv_bool(const char *name)
+{
+	const char *s = getenv(name);
+
+	return s != NULL && *s != '\0' && strcmp(s, "0") != 0;
+}
+
+void
+memlock_setup_process(void)
+{
+	memlock_on = getenv_bool("DDW_LOCK_MEMORY");
+	memlock_count = getenv_bool("DDW_COUNT_FAULTS");
+
+	if (!memlock_on)
+		return;
+
+	if (!SetProcessWorkingSetSize(GetCurrentProcess(), MEMLOCK_WS_MIN, MEMLOCK_WS_MAX))
+		PrintError("SetProcessWorkingSetSize");
+}
+
+//
+// noinline so the array is in a frame of its own, below the caller's
+//
+__attribute__((noinline))
+static void
+prefault_stack(void)
+{
+	volatile char stack[MEMLOCK_STACK];
+
+	for (size_t i = 0; i < sizeof(stack); i += MEMLOCK_PAGE)
+		stack[i] = 0;
+	stack[sizeof(stack)-1] = 0;
+
+	if (!VirtualLock((void *)stack, sizeof(stack)) && !lock_failed) {
+		PrintError("VirtualLock");
+		lock_failed = true;
+	}
+}
+
+void
+memlock_setup_thread(void)
+{
+	if (memlock_on)
+		prefault_stack();
+}
+
+void
+memlock_region(void *p, size_t sz)
+{
+	volatile char *q = p;
+
+	if L (!memlock_on || p == NULL || sz == 0)
+		return;
+
+	// writes, so even pages that were never touched get their own copy
+	//  instead of the shared zero page
+	for (size_t i = 0; i < sz; i += MEMLOCK_PAGE)
+		q[i] = q[i];
+	q[sz-1] = q[sz-1];
+
+	if (!VirtualLock(p, sz) && !lock_failed) {
+		PrintError("VirtualLock");
+		lock_failed = true;
+	}
+}
+
+void
+memlock_unlock(void *p, size_t sz)
+{
+	uintptr_t start, end;
+
+	if L (!memlock_on || p == NULL || sz == 0)
+		return;
+
+	// only the pages that are all inside it, the ones at the ends may have
+	//  another block on them that's still locked
+	start = ((uintptr_t)p+MEMLOCK_PAGE-1) & ~(uintptr_t)(MEMLOCK_PAGE-1);
+	end = ((uintptr_t)p+sz) & ~(uintptr_t)(MEMLOCK_PAGE-1);
+
+	// (fails for pages that never got locked, which is fine)
+	if (end > start)
+		VirtualUnlock((void *)start, end-start);
+}
+
+uint32_t
+memlock_faults(void)
+{
+	PROCESS_MEMORY_COUNTERS pmc = {.cb = sizeof(pmc)};
+
+	if U (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+
+	return pmc.PageFaultCount;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// keeping the audio path from page faulting, set up from the environment:
+//
+//   DDW_LOCK_MEMORY=1      prefault and VirtualLock() the buffers as they're
+//                          sized (buf_prepare_capacity(), the resampler),
+//                          the flight recorder and the top of the processing
+//                          thread's stack
+//   DDW_COUNT_FAULTS=1     count the process's page faults for every block
+//                          in the flight recorder
+//
+// the plugin sets these from ddw.lock_memory and ddw.count_faults. whether
+//  VirtualLock() pins anything under wine depends on its version, the
+//  prefaulting is what gets rid of the faults on the first blocks after a
+//  format change
+//
+
+extern bool memlock_on;
+extern bool memlock_count;
+
+//
+// call from the main thread before anything is allocated for processing
+//
+void
+memlock_setup_process(void);
+
+//
+// call from the processing thread, and the split= instances' threads
+//
+void
+memlock_setup_thread(void);
+
+//
+// touch every page of p and lock it, if DDW_LOCK_MEMORY is set
+//
+void
+memlock_region(void *p, size_t sz);
+
+//
+// undo memlock_region() for a block that's about to be freed or realloc()'d
+//
+void
+memlock_unlock(void *p, size_t sz);
+
+//
+// page faults of the whole process so far. windows doesn't count soft and
+//  hard ones separately
+//
+uint32_t
+memlock_faults(void);
@@ -2,8 +2,11 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "flight.h"
+#include "log.h"
 #include "macros.h"
 
 void
@@ -11,6 +14,10 @@ assert_fail(const char *fmt, const char *arg1, const char *arg2)
 {
 	static _Thread_local char deathmsg[256];
 	int rv = snprintf(deathmsg, sizeof(deathmsg), fmt, arg1, arg2);
+
+	// the warnings from just before are likely what explains it
+	log_deinit();
+
 	if (rv > 0) {
 		if ((unsigned)rv >= sizeof(deathmsg)) {
 			rv = sizeof(deathmsg)-1;
@@ -18,6 +25,7 @@ assert_fail(const char *fmt, const char *arg1, const char *arg2)
 		}
 		write_full(2, deathmsg, rv);
 	}
+	flight_dump(deathmsg);
 	abort();
 }
 
@@ -106,6 +114,69 @@ again:
 	goto again;
 }
 
+//
+// all zero bytes? (digital silence in any format)
+//
+bool
+is_zero(const void *p_, size_t sz)
+{
+	const unsigned char *p = p_;
+	uint64_t acc = 0;
+	size_t i = 0;
+
+	// a cache line at a time so the compiler can vectorize the inner loop,
+	//  and it stops at the first one with sound in it
+	for (; i+64 <= sz; i += 64) {
+		uint64_t w[8];
+
+		memcpy(w, p+i, sizeof(w));
+		for (int j = 0; j < 8; j++)
+			acc |= w[j];
+		if (acc != 0)
+			return false;
+	}
+	for (; i < sz; i++)
+		acc |= p[i];
+
+	return acc == 0;
+}
+
+//
+// monotonic time in nanoseconds
+//
+uint64_t
+now_ns(void)
+{
+	static LONGLONG freq = 0;
+	LARGE_INTEGER t;
+
+	if U (freq == 0) {
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		freq = f.QuadPart;
+	}
+
+	QueryPerformanceCounter(&t);
+
+	return (uint64_t)(t.QuadPart/freq)*1000000000 +
+	    (uint64_t)(t.QuadPart%freq)*1000000000/freq;
+}
+
+//
+// small and good enough for picking chunk sizes. *state must not be 0
+//
+uint32_t
+xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return *state = x;
+}
+
 LPCSTR
 StrError(LONG Code)
 {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -25,6 +26,15 @@ read_full(int fd, void *p_, size_t sz);
 bool
 write_full(int fd, const void *p_, size_t sz);
 
+bool
+is_zero(const void *p_, size_t sz);
+
+uint64_t
+now_ns(void);
+
+uint32_t
+xorshift32(uint32_t *state);
+
 LPCSTR
 StrError(LONG Code);
 
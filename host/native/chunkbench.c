@@ -0,0 +1,393 @@
+//
+// chunkbench: the host's processing core built natively, for measuring the
+//  chunking in plugproc.c without wine
+//
+// runs the given chain (same arguments as ddw_host.exe, but with the stub
+//  modules from dsp_stub.so or any other native "dll") over a grid of chunk
+//  settings and input block sizes, and prints how much time and copying
+//  each combination cost
+//
+// usage: chunkbench [-L] [-r rate] [-b bps] [-c ch] [-s seconds] [-B sizes] plugin...
+//        chunkbench -e [-L] [-S seed] [-N sets] [-r rate] [-b bps] [-c ch] [-s seconds] plugin...
+//
+// e.g. chunkbench native/dsp_stub.so:1 native/dsp_stub.so:2
+//
+// with -e it checks that the chunking doesn't change the output instead: the
+//  same input goes through the chain with random block sizes under the grid's
+//  settings, N random fixed settings and N runs of the randomize option,
+//  all from the one seed, and each output is compared to a run with
+//  unlimited chunking. the plugins are restarted (Quit() and Init()) between
+//  runs. this only makes sense with plugins that give the same output for
+//  the same input however it's cut up, and a plugin that may stretch isn't
+//  held to it, so pass nostretch where it applies. exits with 1 if any
+//  output was different
+//
+// -L prefaults and locks the buffers like DDW_LOCK_MEMORY=1 does (see
+//  memlock.h), the faults column shows what that leaves
+//
+// built with D=1 the UNITTEST blocks run before main()
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../bench.h"
+#include "../chain.h"
+#include "../log.h"
+#include "../macros.h"
+#include "../main.h"
+#include "../memlock.h"
+#include "../misc.h"
+#include "../shm.h"
+
+// -----------------------------------------------------------------------------
+
+// the globals from main.c
+
+int in_fd = -1;
+int out_fd = -1;
+
+struct shmdata *shm = NULL;
+
+struct plugin plugins[MAX_PLUGINS];
+unsigned int plugins_cnt = 0;
+_Atomic int procidx = -1;
+
+HWND mainwin = NULL;
+DWORD main_tid;
+
+// flight.c only uses this with DDW_FLIGHT_NAME, which nothing sets here
+void *
+shmnew(const char *path, size_t sz)
+{
+	(void)path; (void)sz;
+
+	return NULL;
+}
+
+// -----------------------------------------------------------------------------
+
+static const struct chunking {
+	const char *name;
+	int pmf, pMf, pfm;
+} chunkings[] = {
+	{"as given",     -1,   -1,  -1},
+	{"default",      32,  576,  32},
+	{"safemode",    576,  576, 576},
+	{"unlimited",     1,    0,   1},
+	{"pMf=4096",      1, 4096,   1},
+	{"pfm=64",       64, 2048,  64},
+};
+
+static const struct chunking unlimited = {"unlimited", 1, 0, 1};
+
+#define MAX_BLOCK_SIZES 16
+
+static struct plugin_options orig[MAX_PLUGINS];
+
+static void
+apply_chunking(const struct chunking *c)
+{
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		plugins[i].opts.process_min_frames = (c->pmf != -1) ? c->pmf : orig[i].process_min_frames;
+		plugins[i].opts.process_max_frames = (c->pMf != -1) ? c->pMf : orig[i].process_max_frames;
+		plugins[i].opts.process_frames_mult = (c->pfm != -1) ? c->pfm : orig[i].process_frames_mult;
+		plugins[i].opts.randomize = orig[i].randomize;
+	}
+}
+
+//
+// a valid set of chunk settings like plugin_randomize_opts() would make
+//
+static void
+random_chunking(uint32_t *rng, struct chunking *out)
+{
+	static const int mults[] = {1, 1, 8, 26, 32, 64, 576};
+	int pfm = mults[xorshift32(rng) % (sizeof(mults)/sizeof(*mults))];
+	int pmf = pfm*(xorshift32(rng) % 64);
+	int pMf = (xorshift32(rng) % 4 == 0) ? 0 : pfm*(1+xorshift32(rng) % 128);
+
+	if (pmf == 0)
+		pmf = pfm;
+	if (pMf != 0 && pMf < pmf)
+		pMf = pmf;
+
+	*out = (struct chunking){NULL, pmf, pMf, pfm};
+}
+
+static int
+parse_sizes(const char *s, unsigned int *out)
+{
+	char *dup = strdup(s);
+	char *p = dup;
+	int n = 0;
+	bool last;
+
+	do {
+		char *end = strchrnul(p, ',');
+		int v;
+
+		last = (*end == '\0');
+		*end = '\0';
+
+		if (n == MAX_BLOCK_SIZES || !atoi_ok(p, &v) || v <= 0) {
+			n = -1;
+			break;
+		}
+		out[n++] = v;
+
+		p = end+1;
+	} while (!last);
+
+	free(dup);
+	return n;
+}
+
+static void
+print_header(void)
+{
+	printf("%-28s %6s %9s %10s %10s %9s %8s %7s  %s\n",
+	    "chunks", "block", "ns/frame", "calls/kfr", "copyB/fr", "carry_fr", "out/in", "faults", "output");
+}
+
+static void
+print_result(const char *name, const struct bench_input *in, const struct bench_result *r, const char *verdict)
+{
+	char block[16];
+
+	if (in->block_frames != 0)
+		snprintf(block, sizeof(block), "%u", in->block_frames);
+	else
+		snprintf(block, sizeof(block), "rand");
+
+	printf("%-28s %6s %9.2f %10.2f %10.2f %9u %8.3f %7llu  %s\n",
+	    name, block,
+	    (double)r->ns/r->frames_in,
+	    (double)r->calls*1000/r->frames_in,
+	    (double)r->copy_bytes/r->frames_in,
+	    fmt_bytes2frames(&in->fmt, r->carry_max),
+	    (double)r->frames_out/r->frames_in,
+	    r->faults,
+	    verdict);
+}
+
+static bool
+run_grid(struct bench_input *in, const unsigned int *sizes, int nsizes)
+{
+	for (size_t c = 0; c < sizeof(chunkings)/sizeof(*chunkings); c++) {
+		apply_chunking(&chunkings[c]);
+
+		for (int s = 0; s < nsizes; s++) {
+			struct bench_result r;
+
+			in->block_frames = sizes[s];
+			if (!bench_chain(in, NULL, &r))
+				return false;
+
+			print_result(chunkings[c].name, in, &r, "");
+		}
+	}
+
+	return true;
+}
+
+//
+// one run of the equivalence check. the plugins start from scratch each time
+//
+static bool
+run_fresh(const struct bench_input *in, struct buf *output, struct bench_result *r)
+{
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		if (!plugin_restart(&plugins[i]))
+			return false;
+		plugins[i].random_state = 0;
+		plugins[i].random_cnt = 0;
+	}
+
+	buf_clear(output);
+
+	return bench_chain(in, output, r);
+}
+
+//
+// "ok", or what was different
+// whatever is still buffered in the plugins at the end depends on the
+//  chunking, so only as much as both runs output is compared
+//
+static const char *
+compare_output(const struct fmt *fmt, const struct buf *ref, const struct buf *out, bool check)
+{
+	static char msg[64];
+	size_t n = MIN(ref->sz, out->sz);
+	size_t i;
+
+	if (!check)
+		return "(stretch, not checked)";
+
+	for (i = 0; i < n && ref->p[i] == out->p[i]; i++)
+		continue;
+
+	if (i < n)
+		snprintf(msg, sizeof(msg), "DIFFERENT from frame %u",
+		    fmt_bytes2frames(fmt, i));
+	else if (out->sz < ref->sz)
+		snprintf(msg, sizeof(msg), "ok (%u frames short)",
+		    fmt_bytes2frames(fmt, ref->sz-out->sz));
+	else
+		snprintf(msg, sizeof(msg), "ok");
+
+	return msg;
+}
+
+static bool
+run_equivalence(struct bench_input *in, uint32_t seed, int nsets, bool *all_ok)
+{
+	struct buf ref = {0};
+	struct buf out = {0};
+	struct bench_result r;
+	uint32_t rng = seed ?: 1;
+	bool check = true;
+	bool ok = false;
+	char name[64];
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		if (plugins[i].opts.may_stretch)
+			check = false;
+	}
+
+	*all_ok = true;
+
+	// the reference: everything goes through in one piece
+	apply_chunking(&unlimited);
+	in->block_frames = BENCH_RANDOM_BLOCK_MAX;
+	if (!run_fresh(in, &ref, &r))
+		goto out;
+	print_result("reference (unlimited)", in, &r, "");
+
+	for (int set = 0; set < (int)(sizeof(chunkings)/sizeof(*chunkings))+2*nsets; set++) {
+		struct chunking c;
+		const char *verdict;
+
+		in->block_frames = 0;
+		in->seed = xorshift32(&rng);
+
+		if (set < (int)(sizeof(chunkings)/sizeof(*chunkings))) {
+			c = chunkings[set];
+			apply_chunking(&c);
+			snprintf(name, sizeof(name), "%s", c.name);
+		} else if (set < (int)(sizeof(chunkings)/sizeof(*chunkings))+nsets) {
+			random_chunking(&rng, &c);
+			apply_chunking(&c);
+			snprintf(name, sizeof(name), "pmf=%d pMf=%d pfm=%d", c.pmf, c.pMf, c.pfm);
+		} else {
+			apply_chunking(&chunkings[0]);
+			for (unsigned int i = 0; i < plugins_cnt; i++) {
+				plugins[i].opts.randomize = 1;
+				plugins[i].opts.seed = xorshift32(&rng) & 0x7fffffff;
+			}
+			snprintf(name, sizeof(name), "randomize seed=%d", plugins[0].opts.seed);
+		}
+
+		if (!run_fresh(in, &out, &r))
+			goto out;
+
+		verdict = compare_output(&in->fmt, &ref, &out, check);
+		if (verdict[0] == 'D')
+			*all_ok = false;
+
+		print_result(name, in, &r, verdict);
+	}
+
+	ok = true;
+out:
+	for (unsigned int i = 0; i < plugins_cnt; i++)
+		plugins[i].opts.seed = orig[i].seed;
+	buf_free(&ref);
+	buf_free(&out);
+
+	return ok;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: chunkbench [-L] [-r rate] [-b bps] [-c ch] [-s seconds] [-B size,size...] plugin...\n");
+	fprintf(stderr, "       chunkbench -e [-L] [-S seed] [-N sets] [-r rate] [-b bps] [-c ch] [-s seconds] plugin...\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench_input in = {
+		.fmt = {.rate = 44100, .bps = 16, .ch = 2},
+	};
+	int seconds = 60;
+	unsigned int sizes[MAX_BLOCK_SIZES] = {100, 441, 576, 1024, 4096};
+	int nsizes = 5;
+	bool equivalence = false;
+	int seed = 1;
+	int nsets = 20;
+	bool all_ok = true;
+	bool ok;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:b:c:s:B:eS:N:L")) != -1) {
+		switch (opt) {
+		case 'r': if (!atoi_ok(optarg, &in.fmt.rate)) usage(); break;
+		case 'b': if (!atoi_ok(optarg, &in.fmt.bps)) usage(); break;
+		case 'c': if (!atoi_ok(optarg, &in.fmt.ch)) usage(); break;
+		case 's': if (!atoi_ok(optarg, &seconds)) usage(); break;
+		case 'B': if ((nsizes = parse_sizes(optarg, sizes)) <= 0) usage(); break;
+		case 'e': equivalence = true; break;
+		case 'S': if (!atoi_ok(optarg, &seed)) usage(); break;
+		case 'N': if (!atoi_ok(optarg, &nsets) || nsets < 0) usage(); break;
+		case 'L': memlock_on = true; break;
+		default: usage();
+		}
+	}
+	if (optind == argc || !fmt_makes_sense(&in.fmt) || seconds <= 0)
+		usage();
+
+	in.frames = (unsigned long long)seconds*in.fmt.rate;
+
+	memlock_setup_thread();
+
+	for (int i = optind; i < argc; i++) {
+		if (plugins_cnt == MAX_PLUGINS) {
+			fprintf(stderr, "error: too many plugins (%d max)\n", MAX_PLUGINS);
+			return 1;
+		}
+		if (!parse_plugin_options(argv[i], &plugins[plugins_cnt].opts)) {
+			fprintf(stderr, "error: option parsing failed for argument \"%s\"\n", argv[i]);
+			return 1;
+		}
+		if (!load_plugin(&plugins[plugins_cnt])) {
+			fprintf(stderr, "error: plugin load failed for dll \"%s\"\n",
+			    plugins[plugins_cnt].opts.path);
+			return 1;
+		}
+		orig[plugins_cnt] = plugins[plugins_cnt].opts;
+		plugins_cnt++;
+	}
+
+	log_init();
+
+	printf("format: %d Hz, %d bit, %d ch, %d s per run\n",
+	    in.fmt.rate, in.fmt.bps, in.fmt.ch, seconds);
+	print_header();
+
+	if (equivalence)
+		ok = run_equivalence(&in, seed, nsets, &all_ok);
+	else
+		ok = run_grid(&in, sizes, nsizes);
+
+	log_deinit();
+
+	for (unsigned int i = 0; i < plugins_cnt; i++)
+		unload_plugin(&plugins[i]);
+
+	return (ok && all_ok) ? 0 : 1;
+}
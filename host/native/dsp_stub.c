@@ -0,0 +1,230 @@
+//
+// dsp_stub.so: fake winamp dsp "dll" for the native build
+//
+// each module stands in for a kind of real plugin as far as the chunking in
+//  plugproc.c is concerned. the audio itself isn't changed in any
+//  interesting way
+//
+//   0: passthrough
+//   1: delay      buffers STUB_DELAY_FRAMES frames before outputting anything,
+//                 then returns as many frames as it's given (like plugins
+//                 with a lookahead)
+//   2: stretch    doubles every frame (2x stretch)
+//   3: shrink     drops every other frame
+//   4: random     returns 0..2x as many frames as it's given, chosen at random
+//                 from a fixed seed
+//
+// like real dlls, the state is global, so two plugins can't share a module
+//
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <Winamp/DSP.H>
+
+#define STUB_DELAY_FRAMES 1024
+#define STUB_RANDOM_SEED 1234
+
+static struct stubfmt {
+	int bps;
+	int nch;
+	int srate;
+} lastfmt;
+
+// delay line for the delay module
+static char *delay_p;
+static size_t delay_sz;
+static size_t delay_cap;
+
+// frame counter for the shrink module, so odd sizes keep the pattern
+static unsigned long long shrink_pos;
+
+static unsigned int random_state = STUB_RANDOM_SEED;
+
+// -----------------------------------------------------------------------------
+
+//
+// forget everything on a format change, like a real plugin would have to
+//
+static void
+check_format(int bps, int nch, int srate)
+{
+	if (bps == lastfmt.bps && nch == lastfmt.nch && srate == lastfmt.srate)
+		return;
+
+	lastfmt = (struct stubfmt){bps, nch, srate};
+	delay_sz = 0;
+	shrink_pos = 0;
+}
+
+static int
+passthrough(struct winampDSPModule *this_mod, short int *samples, int numsamples, int bps, int nch, int srate)
+{
+	(void)this_mod; (void)samples; (void)bps; (void)nch; (void)srate;
+
+	return numsamples;
+}
+
+static int
+delay(struct winampDSPModule *this_mod, short int *samples, int numsamples, int bps, int nch, int srate)
+{
+	size_t fs = (bps/8)*nch;
+	size_t insz = fs*numsamples;
+	size_t outsz;
+
+	(void)this_mod;
+
+	check_format(bps, nch, srate);
+
+	if (delay_cap < delay_sz+insz) {
+		delay_cap = delay_sz+insz;
+		delay_p = realloc(delay_p, delay_cap);
+		if (delay_p == NULL)
+			abort();
+	}
+	memcpy(delay_p+delay_sz, samples, insz);
+	delay_sz += insz;
+
+	if (delay_sz <= fs*STUB_DELAY_FRAMES)
+		return 0;
+
+	outsz = delay_sz-fs*STUB_DELAY_FRAMES;
+	memcpy(samples, delay_p, outsz);
+	memmove(delay_p, delay_p+outsz, delay_sz-outsz);
+	delay_sz -= outsz;
+
+	return outsz/fs;
+}
+
+static int
+stretch(struct winampDSPModule *this_mod, short int *samples, int numsamples, int bps, int nch, int srate)
+{
+	size_t fs = (bps/8)*nch;
+	char *p = (char *)samples;
+
+	(void)this_mod; (void)srate;
+
+	// back to front so nothing is overwritten before it's copied
+	for (int i = numsamples-1; i >= 0; i--) {
+		memmove(p+fs*(2*i+1), p+fs*i, fs);
+		memmove(p+fs*(2*i), p+fs*i, fs);
+	}
+
+	return numsamples*2;
+}
+
+static int
+shrink(struct winampDSPModule *this_mod, short int *samples, int numsamples, int bps, int nch, int srate)
+{
+	size_t fs = (bps/8)*nch;
+	char *p = (char *)samples;
+	int out = 0;
+
+	(void)this_mod;
+
+	check_format(bps, nch, srate);
+
+	for (int i = 0; i < numsamples; i++) {
+		if (shrink_pos++ % 2 == 0)
+			memmove(p+fs*out++, p+fs*i, fs);
+	}
+
+	return out;
+}
+
+static int
+random_size(struct winampDSPModule *this_mod, short int *samples, int numsamples, int bps, int nch, int srate)
+{
+	size_t fs = (bps/8)*nch;
+	char *p = (char *)samples;
+	int out = rand_r(&random_state) % (2*numsamples+1);
+	char *in;
+
+	(void)this_mod; (void)srate;
+
+	if (out == 0 || out == numsamples)
+		return out;
+
+	// nearest neighbour resample to the new length
+	in = malloc(fs*numsamples);
+	if (in == NULL)
+		abort();
+	memcpy(in, p, fs*numsamples);
+	for (int i = 0; i < out; i++)
+		memcpy(p+fs*i, in+fs*((long long)i*numsamples/out), fs);
+	free(in);
+
+	return out;
+}
+
+// -----------------------------------------------------------------------------
+
+static void
+config(struct winampDSPModule *this_mod)
+{
+	(void)this_mod;
+}
+
+static int
+init(struct winampDSPModule *this_mod)
+{
+	(void)this_mod;
+
+	lastfmt = (struct stubfmt){0};
+	random_state = STUB_RANDOM_SEED;
+
+	return 0;
+}
+
+static void
+quit(struct winampDSPModule *this_mod)
+{
+	(void)this_mod;
+
+	free(delay_p);
+	delay_p = NULL;
+	delay_sz = delay_cap = 0;
+}
+
+#define STUB_MODULE(desc, fn) { \
+	.description = desc, \
+	.Config = config, \
+	.Init = init, \
+	.ModifySamples = fn, \
+	.Quit = quit, \
+}
+
+static winampDSPModule modules[] = {
+	STUB_MODULE("passthrough", passthrough),
+	STUB_MODULE("delay", delay),
+	STUB_MODULE("2x stretch", stretch),
+	STUB_MODULE("shrink 2x", shrink),
+	STUB_MODULE("random output size", random_size),
+};
+
+static winampDSPModule *
+get_module(int which)
+{
+	if (which < 0 || (size_t)which >= sizeof(modules)/sizeof(*modules))
+		return NULL;
+
+	return &modules[which];
+}
+
+static winampDSPHeader header = {
+	.version = DSP_HDRVER,
+	.description = "dsp_stub: fake modules for the native build",
+	.getModule = get_module,
+};
+
+__attribute__((visibility("default")))
+winampDSPHeader *
+winampDSPGetHeader2(HWND hwndParent);
+
+winampDSPHeader *
+winampDSPGetHeader2(HWND hwndParent)
+{
+	(void)hwndParent;
+
+	return &header;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// see windows.h
+
+#include <sys/resource.h>
+
+typedef struct {
+	DWORD cb;
+	DWORD PageFaultCount;
+} PROCESS_MEMORY_COUNTERS;
+
+// soft and hard together like windows
+static inline BOOL
+GetProcessMemoryInfo(HANDLE h, PROCESS_MEMORY_COUNTERS *pmc, DWORD sz)
+{
+	struct rusage ru;
+
+	(void)h; (void)sz;
+
+	if (getrusage(RUSAGE_SELF, &ru) == -1)
+		return 0;
+
+	pmc->PageFaultCount = ru.ru_minflt+ru.ru_majflt;
+
+	return 1;
+}
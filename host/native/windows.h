@@ -0,0 +1,540 @@
+#pragma once
+
+//
+// just enough of windows.h to build the processing core natively
+//  (make native), with the win32 calls mapped to their posix equivalents
+//
+// only what buf.c, fmt.c, plugproc.c, plugload.c, split.c, chain.c, log.c,
+//  misc.c, flight.c, memlock.c and sched.c need. anything to do with windows or
+//  messages stays in the .exe
+//
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <glob.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#define WINAPI
+#define CALLBACK
+#define VOID void
+
+typedef int BOOL;
+
+#define TRUE 1
+#define FALSE 0
+
+typedef unsigned int UINT;
+typedef unsigned long DWORD;
+typedef long LONG;
+typedef unsigned long ULONG;
+typedef char CHAR;
+typedef int64_t LONGLONG;
+typedef const char *LPCSTR;
+typedef char *LPSTR;
+typedef DWORD *LPDWORD;
+typedef uintptr_t DWORD_PTR;
+typedef long HRESULT;
+typedef wchar_t WCHAR;
+
+typedef void *HANDLE;
+typedef void *HWND;
+typedef void *HMODULE;
+typedef void *HINSTANCE;
+
+typedef union {
+	struct {
+		DWORD LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define MAX_PATH 260
+
+#define FORMAT_MESSAGE_FROM_SYSTEM 0x1000
+
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define PAGE_READWRITE 0x04
+
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define INFINITE 0xFFFFFFFF
+
+#define STACK_SIZE_PARAM_IS_A_RESERVATION 0x00010000
+
+#define SYNCHRONIZE 0x00100000L
+#define ERROR_ACCESS_DENIED EPERM
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+
+#define THREAD_PRIORITY_LOWEST -2
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_PRIORITY_HIGHEST 2
+#define THREAD_PRIORITY_TIME_CRITICAL 15
+
+// -----------------------------------------------------------------------------
+
+static inline DWORD
+GetLastError(void)
+{
+	return errno;
+}
+
+static inline DWORD
+FormatMessageA(DWORD flags, const void *src, DWORD code, DWORD lang,
+               LPSTR buf, DWORD sz, void *args)
+{
+	(void)flags; (void)src; (void)lang; (void)args;
+
+	return snprintf(buf, sz, "%s", strerror(code));
+}
+
+static inline DWORD
+GetCurrentProcessId(void)
+{
+	return getpid();
+}
+
+static inline DWORD
+GetTempPath(DWORD sz, LPSTR buf)
+{
+	const char *dir = getenv("TMPDIR") ?: "/tmp";
+
+	return snprintf(buf, sz, "%s/", dir);
+}
+
+static inline void
+Sleep(DWORD ms)
+{
+	struct timespec ts = {
+		.tv_sec = ms/1000,
+		.tv_nsec = (long)(ms%1000)*1000000,
+	};
+
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		continue;
+}
+
+// -----------------------------------------------------------------------------
+
+static inline BOOL
+QueryPerformanceFrequency(LARGE_INTEGER *f)
+{
+	f->QuadPart = 1000000000;
+	return 1;
+}
+
+static inline BOOL
+QueryPerformanceCounter(LARGE_INTEGER *t)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t->QuadPart = (LONGLONG)ts.tv_sec*1000000000 + ts.tv_nsec;
+
+	return 1;
+}
+
+// -----------------------------------------------------------------------------
+
+// never freed, same as the flight recorder's
+static inline void *
+VirtualAlloc(void *addr, size_t sz, DWORD type, DWORD prot)
+{
+	(void)addr; (void)type; (void)prot;
+
+	return calloc(1, sz);
+}
+
+static inline BOOL
+VirtualLock(void *addr, size_t sz)
+{
+	return mlock(addr, sz) == 0;
+}
+
+static inline BOOL
+VirtualUnlock(void *addr, size_t sz)
+{
+	return munlock(addr, sz) == 0;
+}
+
+// -----------------------------------------------------------------------------
+
+static inline HANDLE
+GetCurrentProcess(void)
+{
+	return NULL;
+}
+
+// RLIMIT_MEMLOCK is what limits mlock(), nothing to raise here
+static inline BOOL
+SetProcessWorkingSetSize(HANDLE h, size_t min, size_t max)
+{
+	(void)h; (void)min; (void)max;
+
+	return 1;
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// the stub dlls in native/ are shared objects
+//
+static inline HMODULE
+LoadLibrary(LPCSTR path)
+{
+	void *h = dlopen(path, RTLD_NOW|RTLD_LOCAL);
+
+	if (h == NULL) {
+		fprintf(stderr, "dlopen: %s\n", dlerror());
+		errno = ENOENT;
+	}
+
+	return h;
+}
+
+// nothing is loaded by name natively, so sched.c finds no kernel32.dll
+static inline HMODULE
+GetModuleHandle(LPCSTR name)
+{
+	(void)name;
+
+	return NULL;
+}
+
+static inline void *
+GetProcAddress(HMODULE h, LPCSTR name)
+{
+	// (dlsym() would search everything with NULL)
+	if (h == NULL)
+		return NULL;
+
+	return dlsym(h, name);
+}
+
+static inline BOOL
+FreeLibrary(HMODULE h)
+{
+	return dlclose(h) == 0;
+}
+
+static inline BOOL
+CopyFile(LPCSTR from, LPCSTR to, BOOL fail_if_exists)
+{
+	char buf[65536];
+	FILE *in, *out;
+	size_t n;
+	bool ok = true;
+
+	in = fopen(from, "rb");
+	if (in == NULL)
+		return 0;
+	out = fopen(to, fail_if_exists ? "wbx" : "wb");
+	if (out == NULL) {
+		fclose(in);
+		return 0;
+	}
+
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		if (fwrite(buf, 1, n, out) != n) {
+			ok = false;
+			break;
+		}
+	}
+	if (ferror(in))
+		ok = false;
+
+	fclose(in);
+	if (fclose(out) != 0)
+		ok = false;
+
+	return ok;
+}
+
+static inline BOOL
+DeleteFile(LPCSTR path)
+{
+	return unlink(path) == 0;
+}
+
+typedef struct {
+	char cFileName[MAX_PATH];
+} WIN32_FIND_DATA;
+
+struct native_find {
+	glob_t g;
+	size_t next;
+};
+
+static inline BOOL
+native_find_next(struct native_find *f, WIN32_FIND_DATA *fd)
+{
+	char *p;
+
+	if (f->next >= f->g.gl_pathc)
+		return 0;
+
+	p = strdup(f->g.gl_pathv[f->next++]);
+	if (p == NULL)
+		return 0;
+	snprintf(fd->cFileName, sizeof(fd->cFileName), "%s", basename(p));
+	free(p);
+
+	return 1;
+}
+
+// with its own close function, so not a handle like the ones below
+static inline HANDLE
+FindFirstFile(LPCSTR pattern, WIN32_FIND_DATA *fd)
+{
+	struct native_find *f = calloc(1, sizeof(*f));
+
+	if (f == NULL)
+		return INVALID_HANDLE_VALUE;
+
+	if (glob(pattern, 0, NULL, &f->g) != 0 || !native_find_next(f, fd)) {
+		globfree(&f->g);
+		free(f);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	return f;
+}
+
+static inline BOOL
+FindNextFile(HANDLE h, WIN32_FIND_DATA *fd)
+{
+	return native_find_next(h, fd);
+}
+
+static inline BOOL
+FindClose(HANDLE h)
+{
+	struct native_find *f = h;
+
+	globfree(&f->g);
+	free(f);
+
+	return 1;
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// handles are threads, events or processes, told apart by the first member
+//
+enum native_handle_kind {
+	NATIVE_THREAD,
+	NATIVE_EVENT,
+	NATIVE_PROCESS,
+};
+
+struct native_event {
+	enum native_handle_kind kind;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool manual;
+	bool set;
+};
+
+struct native_thread {
+	enum native_handle_kind kind;
+	pthread_t thread;
+	DWORD (*fn)(void *);
+	void *arg;
+};
+
+struct native_process {
+	enum native_handle_kind kind;
+	pid_t pid;
+};
+
+union native_handle {
+	struct native_event event;
+	struct native_thread thread;
+	struct native_process process;
+};
+
+static inline void *
+native_thread_start(void *ud)
+{
+	struct native_thread *t = ud;
+
+	return (void *)(uintptr_t)t->fn(t->arg);
+}
+
+static inline HANDLE
+CreateThread(void *sa, size_t stacksz, DWORD (*fn)(void *), void *arg,
+             DWORD flags, DWORD *tid)
+{
+	struct native_thread *t = malloc(sizeof(*t));
+	int err;
+
+	(void)sa; (void)stacksz; (void)flags;
+
+	if (t == NULL)
+		return NULL;
+
+	t->kind = NATIVE_THREAD;
+	t->fn = fn;
+	t->arg = arg;
+
+	err = pthread_create(&t->thread, NULL, native_thread_start, t);
+	if (err != 0) {
+		free(t);
+		errno = err;
+		return NULL;
+	}
+
+	if (tid != NULL)
+		*tid = 0;
+
+	return t;
+}
+
+static inline HANDLE
+GetCurrentThread(void)
+{
+	return NULL;
+}
+
+// priorities are left alone, they mostly need root on linux
+static inline BOOL
+SetThreadPriority(HANDLE h, int prio)
+{
+	(void)h; (void)prio;
+
+	return 1;
+}
+
+// and so are affinities, the benchmark doesn't need them
+static inline DWORD_PTR
+SetThreadAffinityMask(HANDLE h, DWORD_PTR mask)
+{
+	(void)h;
+
+	return mask;
+}
+
+static inline BOOL
+SetProcessAffinityMask(HANDLE h, DWORD_PTR mask)
+{
+	(void)h; (void)mask;
+
+	return 1;
+}
+
+// only for seeing whether it's still running
+static inline HANDLE
+OpenProcess(DWORD access, BOOL inherit, DWORD pid)
+{
+	struct native_process *p;
+
+	(void)access; (void)inherit;
+
+	if (kill((pid_t)pid, 0) == -1)
+		return NULL;
+
+	// (as big as any handle, the functions that take them read them as
+	//  whichever kind until they've checked)
+	p = malloc(sizeof(union native_handle));
+	if (p == NULL)
+		return NULL;
+	*p = (struct native_process){
+		.kind = NATIVE_PROCESS,
+		.pid = (pid_t)pid,
+	};
+
+	return p;
+}
+
+static inline HANDLE
+CreateEvent(void *sa, BOOL manual, BOOL initial, LPCSTR name)
+{
+	struct native_event *e = malloc(sizeof(*e));
+
+	(void)sa; (void)name;
+
+	if (e == NULL)
+		return NULL;
+
+	*e = (struct native_event){
+		.kind = NATIVE_EVENT,
+		.manual = manual,
+		.set = initial,
+	};
+	pthread_mutex_init(&e->mutex, NULL);
+	pthread_cond_init(&e->cond, NULL);
+
+	return e;
+}
+
+static inline BOOL
+SetEvent(HANDLE h)
+{
+	struct native_event *e = h;
+
+	pthread_mutex_lock(&e->mutex);
+	e->set = true;
+	pthread_cond_broadcast(&e->cond);
+	pthread_mutex_unlock(&e->mutex);
+
+	return 1;
+}
+
+// the timeout is ignored for threads, and for events unless it's 0 or INFINITE
+static inline DWORD
+WaitForSingleObject(HANDLE h, DWORD ms)
+{
+	enum native_handle_kind kind = *(enum native_handle_kind *)h;
+	struct native_thread *t = h;
+	struct native_process *p = h;
+	struct native_event *e = h;
+	DWORD rv = WAIT_OBJECT_0;
+
+	if (kind == NATIVE_THREAD)
+		return pthread_join(t->thread, NULL) == 0 ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+
+	// (can't wait for a process that isn't a child, this is just for 0)
+	if (kind == NATIVE_PROCESS)
+		return (kill(p->pid, 0) == -1 && errno == ESRCH) ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+
+	pthread_mutex_lock(&e->mutex);
+	while (!e->set && ms != 0)
+		pthread_cond_wait(&e->cond, &e->mutex);
+	if (e->set) {
+		if (!e->manual)
+			e->set = false;
+	} else {
+		rv = WAIT_TIMEOUT;
+	}
+	pthread_mutex_unlock(&e->mutex);
+
+	return rv;
+}
+
+static inline BOOL
+CloseHandle(HANDLE h)
+{
+	struct native_event *e = h;
+
+	if (*(enum native_handle_kind *)h == NATIVE_EVENT) {
+		pthread_cond_destroy(&e->cond);
+		pthread_mutex_destroy(&e->mutex);
+	}
+	free(h);
+
+	return 1;
+}
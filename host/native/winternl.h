@@ -0,0 +1,5 @@
+#pragma once
+
+// see windows.h
+
+typedef LONG NTSTATUS;
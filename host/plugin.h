@@ -8,6 +8,8 @@
 #include "buf.h"
 #include "fmt.h"
 
+#define MAX_STRETCH_FACTOR 2
+
 struct plugin {
 	winampDSPModule *module;
 
@@ -24,9 +26,17 @@ struct plugin {
 		int process_max_frames;
 		int process_frames_mult;
 		int may_stretch;
+		int autostretch; // blocks without a stretch before it's trusted not to, 0 = never (default)
 		int doconf;
 		int randomize;
+		int seed; // for randomize. 0 = random
 		int required;
+		int split; // channels per instance, 0 = one instance for all
+		int adapt; // convert to a supported bit depth instead of skipping
+		int resample; // resampler quality for unsupported rates, 0 = off
+		int latency; // frames the dll holds back itself, if it's known
+		int keepsilence; // silence in = silence out once its tail has died out
+		int nocache; // output isn't the same every time, don't let it be cached
 		char *path;
 		char *rate;
 		char *bits;
@@ -34,12 +44,33 @@ struct plugin {
 	} opts;
 
 	int random_cnt;
+	uint32_t random_state; // 0 = not seeded yet
 	size_t lastbufsz;
 
 	int skip;
+	int stretched; // in the last block, for picking how to process the next
+	int calm; // blocks in a row without a stretch
+	int nostretch; // autostretch= decided it doesn't, so no guard copies
+	int bps; // what it runs at, set by chain_set_format()
+	int rate; // same
+	struct resampler *rs; // if rate isn't the stream's
+	int rs_latency; // frames
 	int didconf;
 
+	// counters for the benchmarks. never reset by the host itself
+	struct plugin_stats {
+		unsigned long long calls; // ModifySamples() calls
+		unsigned long long frames_in;
+		unsigned long long frames_out;
+		unsigned long long copy_bytes; // memcpy'd by plugin_process()
+		unsigned long long ns; // in plugin_process()
+		unsigned long long resample_ns; // of that, in the resampler
+	} stats;
+
 	HMODULE dll;
+
+	// the other instances for split=. NULL if there aren't any
+	struct plugin_split *split;
 };
 
 /// plugload.c
@@ -47,17 +78,39 @@ struct plugin {
 bool
 parse_plugin_options(const char *arg, struct plugin_options *out);
 
+winampDSPModule *
+load_module(const char *path, int *module_idx, HMODULE *dll_out, winampDSPHeader **header_out);
+
 bool
 load_plugin(struct plugin *pl);
 
+void
+unload_plugin(struct plugin *pl);
+
 void
 plugin_randomize_opts(struct plugin *pl);
 
+int
+plugin_rand(struct plugin *pl);
+
+bool
+plugin_restart(struct plugin *pl);
+
 const char *
 plugin_supports_format(struct plugin *pl, struct fmt *fmt);
 
 /// plugproc.c
 
+//
+// one ModifySamples() call, through split= if it's on
+//
+int
+plugin_modify_samples(struct plugin *pl,
+                      struct fmt *fmt,
+                      char *samples,
+                      int frames,
+                      int stretch_factor);
+
 void
 plugin_process(struct plugin *pl,
                struct fmt *fmt,
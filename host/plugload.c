@@ -3,9 +3,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "log.h"
 #include "main.h"
 #include "macros.h"
 #include "misc.h"
+#include "resample.h"
+#include "split.h"
 
 //
 // apply safe default values for known plugins
@@ -32,6 +35,8 @@ apply_defaults(const char *path, struct plugin_options *out)
 		// 576*3 may be buggy
 		out->process_max_frames = 576*2;
 		out->doconf = 0;
+		// (doesn't stretch at 100% tempo, then suddenly does, so it's
+		//  no use giving it autostretch=)
 		// 8 = distorts when stretching
 		out->bits = strdup("16,24,32");
 	}
@@ -68,13 +73,21 @@ parse_plugin_options(const char *arg, struct plugin_options *out)
 		{"pMf", 'u', {.i=&out->process_max_frames}},
 		{"pfm", 'u', {.i=&out->process_frames_mult}},
 		{"stretch", 'b', {.i=&out->may_stretch}},
+		{"autostretch", 'u', {.i=&out->autostretch}},
 		{"conf", 'b', {.i=&out->doconf}},
 		{"randomize", 'b', {.i=&out->randomize}},
+		{"seed", 'u', {.i=&out->seed}},
 		{"required", 'b', {.i=&out->required}},
 		{"trace", 'b', {.i=&out->trace}},
 		{"rate", 's', {.s=&out->rate}},
 		{"bits", 's', {.s=&out->bits}},
 		{"ch", 's', {.s=&out->ch}},
+		{"split", 'u', {.i=&out->split}},
+		{"adapt", 'b', {.i=&out->adapt}},
+		{"resample", 'u', {.i=&out->resample}},
+		{"latency", 'u', {.i=&out->latency}},
+		{"keepsilence", 'b', {.i=&out->keepsilence}},
+		{"nocache", 'b', {.i=&out->nocache}},
 		{NULL, 0, {NULL}},
 	};
 
@@ -101,8 +114,10 @@ parse_plugin_options(const char *arg, struct plugin_options *out)
 		.process_max_frames = 576,
 		.process_frames_mult = 32,
 		.may_stretch = 1,
+		.autostretch = 0,
 		.doconf = 1,
 		.randomize = 0,
+		.adapt = 1,
 	};
 
 	do {
@@ -172,6 +187,7 @@ match:
 			out->process_max_frames = 576;
 			out->process_frames_mult = 576;
 			out->may_stretch = 1;
+			out->autostretch = 0;
 			goto next;
 		}
 
@@ -210,8 +226,20 @@ err:
 	return false;
 }
 
-bool
-load_plugin(struct plugin *pl)
+static void
+plugin_seed(struct plugin *pl)
+{
+	pl->random_state = (pl->opts.seed != 0) ? (uint32_t)pl->opts.seed : (uint32_t)rand();
+	if (pl->random_state == 0)
+		pl->random_state = 1;
+}
+
+//
+// LoadLibrary() the dll and Init() one of its modules. *module_idx is set to
+//  the one that was picked if it was MODULE_IDX_DEFAULT
+//
+winampDSPModule *
+load_module(const char *path, int *module_idx, HMODULE *dll_out, winampDSPHeader **header_out)
 {
 	HANDLE dll;
 	winampDSPGetHeaderType get_header;
@@ -219,10 +247,10 @@ load_plugin(struct plugin *pl)
 	winampDSPModule *module = NULL;
 	int init_rv;
 
-	dll = LoadLibrary(pl->opts.path);
+	dll = LoadLibrary(path);
 	if (dll == NULL) {
 		fprintf(stderr, "load_plugin: failed to open %s using LoadLibrary: %s\n",
-		    superbasename(pl->opts.path),
+		    superbasename(path),
 		    StrError(GetLastError()));
 		goto err;
 	}
@@ -230,7 +258,7 @@ load_plugin(struct plugin *pl)
 	get_header = (winampDSPGetHeaderType)(void *)GetProcAddress(dll, "winampDSPGetHeader2");
 	if (get_header == NULL) {
 		fprintf(stderr, "load_plugin: failed to get winampDSPGetHeader2() from %s: %s\n",
-		    superbasename(pl->opts.path),
+		    superbasename(path),
 		    StrError(GetLastError()));
 		goto err;
 	}
@@ -248,22 +276,22 @@ load_plugin(struct plugin *pl)
 		goto err;
 	}
 
-	if (pl->opts.module_idx != MODULE_IDX_DEFAULT) {
-		module = header->getModule(pl->opts.module_idx);
+	if (*module_idx != MODULE_IDX_DEFAULT) {
+		module = header->getModule(*module_idx);
 	} else {
 		if ((module = header->getModule(0)) != NULL)
-			pl->opts.module_idx = 0;
+			*module_idx = 0;
 		else if ((module = header->getModule(1)) != NULL)
-			pl->opts.module_idx = 1;
+			*module_idx = 1;
 	}
 	if (module == NULL) {
-		if (pl->opts.module_idx != MODULE_IDX_DEFAULT)
+		if (*module_idx != MODULE_IDX_DEFAULT)
 			fprintf(stderr, "load_plugin: %s has no module with index %d\n",
-			    superbasename(pl->opts.path),
-			    pl->opts.module_idx);
+			    superbasename(path),
+			    *module_idx);
 		else
 			fprintf(stderr, "load_plugin: %s has no module with index 0 or 1!\n",
-			    superbasename(pl->opts.path));
+			    superbasename(path));
 		goto err;
 	}
 
@@ -277,13 +305,11 @@ load_plugin(struct plugin *pl)
 		goto err;
 	}
 
-	printf("%s: %s\n", superbasename(pl->opts.path), header->description);
-	printf("%s:%d: %s\n", superbasename(pl->opts.path), pl->opts.module_idx, module->description);
-
-	pl->module = module;
-	pl->dll = dll;
+	*dll_out = dll;
+	if (header_out != NULL)
+		*header_out = header;
 
-	return true;
+	return module;
 err:
 	if (module != NULL) {
 		module->hDllInstance = NULL;
@@ -292,7 +318,58 @@ err:
 	if (dll != NULL)
 		FreeLibrary(dll);
 
-	return false;
+	return NULL;
+}
+
+bool
+load_plugin(struct plugin *pl)
+{
+	winampDSPHeader *header;
+
+	pl->module = load_module(pl->opts.path, &pl->opts.module_idx, &pl->dll, &header);
+	if (pl->module == NULL)
+		return false;
+
+	printf("%s: %s\n", superbasename(pl->opts.path), header->description);
+	printf("%s:%d: %s\n", superbasename(pl->opts.path), pl->opts.module_idx, pl->module->description);
+
+	if (pl->opts.randomize) {
+		plugin_seed(pl);
+		printf("%s: randomize seed=%u\n", superbasename(pl->opts.path), pl->random_state);
+	}
+
+	if (pl->opts.split != 0 && !split_load(pl)) {
+		unload_plugin(pl);
+		return false;
+	}
+
+	return true;
+}
+
+void
+unload_plugin(struct plugin *pl)
+{
+	split_free(pl);
+	resample_free(pl);
+
+	pl->module->Quit(pl->module);
+	FreeLibrary(pl->dll);
+
+	pl->module = NULL;
+	pl->dll = NULL;
+}
+
+//
+// the randomize mode has its own generator per plugin so a run can be
+//  repeated exactly with the seed= option
+//
+int
+plugin_rand(struct plugin *pl)
+{
+	if U (pl->random_state == 0)
+		plugin_seed(pl);
+
+	return xorshift32(&pl->random_state) & 0x7fffffff;
 }
 
 void
@@ -303,7 +380,7 @@ plugin_randomize_opts(struct plugin *pl)
 		return;
 	}
 
-	if (rand() % 100 >= 96) {
+	if (plugin_rand(pl) % 100 >= 96) {
 		// make plugin_process() add the data to the buffer without
 		//  processing it
 		// warning: three of these in a row and we'll be restarted for
@@ -315,21 +392,21 @@ plugin_randomize_opts(struct plugin *pl)
 		goto print;
 	}
 
-	switch (rand() % 4) {
+	switch (plugin_rand(pl) % 4) {
 	case 0: pl->opts.process_frames_mult = 1; break;
 	case 1: pl->opts.process_frames_mult = 1; break;
 	case 2: pl->opts.process_frames_mult = 8; break;
 	case 3: pl->opts.process_frames_mult = 26; break;
 	}
 
-	switch (rand() % 4) {
+	switch (plugin_rand(pl) % 4) {
 	case 0: pl->opts.process_min_frames = 1; break;
 	case 1: pl->opts.process_min_frames = 64; break;
 	case 2: pl->opts.process_min_frames = 151; break;
 	case 3: pl->opts.process_min_frames = 1567; break;
 	}
 
-	switch (rand() % 4) {
+	switch (plugin_rand(pl) % 4) {
 	case 0: pl->opts.process_max_frames = 201; break;
 	case 1: pl->opts.process_max_frames = 4096; break;
 	case 2: pl->opts.process_max_frames = 512; break;
@@ -348,12 +425,35 @@ plugin_randomize_opts(struct plugin *pl)
 #undef NEXTMULT
 #undef MULTUP
 
-	pl->random_cnt = rand() % 4;
+	pl->random_cnt = plugin_rand(pl) % 4;
 print:
-	fprintf(stderr, "pfm=%d pmf=%d pMf=%d\n",
+	log_post(LOG_RANDOMIZED, pl->opts.path,
 	    pl->opts.process_frames_mult,
 	    pl->opts.process_min_frames,
-	    pl->opts.process_max_frames);
+	    pl->opts.process_max_frames,
+	    0);
+}
+
+//
+// Quit() and Init() the module again, to get rid of its internal state
+//  without reloading the dll
+//
+bool
+plugin_restart(struct plugin *pl)
+{
+	int init_rv;
+
+	pl->module->Quit(pl->module);
+
+	init_rv = pl->module->Init(pl->module);
+	if (init_rv != 0) {
+		fprintf(stderr, "plugin_restart: Init() failed for %s! (%d)\n",
+		    superbasename(pl->opts.path),
+		    init_rv);
+		return false;
+	}
+
+	return split_restart(pl);
 }
 
 static bool
@@ -397,6 +497,23 @@ plugin_supports_format(struct plugin *pl, struct fmt *fmt)
 	if (pl->opts.bits != NULL && !match_string(pl->opts.bits, bitstr))
 		return "bit depth";
 
+	// with split=, ch= is about the channels each instance gets. the last
+	//  one gets what's left over
+	if (split_groups(pl, fmt) != 0) {
+		if (split_groups(pl, fmt) > split_instances(pl))
+			return "channel count";
+
+		snprintf(chstr, sizeof(chstr), "%d", pl->opts.split);
+		if (pl->opts.ch != NULL && !match_string(pl->opts.ch, chstr))
+			return "channel count";
+
+		snprintf(chstr, sizeof(chstr), "%d", fmt->ch % pl->opts.split);
+		if (pl->opts.ch != NULL && fmt->ch % pl->opts.split != 0 && !match_string(pl->opts.ch, chstr))
+			return "channel count";
+
+		return NULL;
+	}
+
 	if (pl->opts.ch != NULL && !match_string(pl->opts.ch, chstr))
 		return "channel count";
 
@@ -1,13 +1,16 @@
 #include "plugin.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "flight.h"
+#include "log.h"
 #include "main.h"
 #include "macros.h"
 #include "misc.h"
-
-#define MAX_STRETCH_FACTOR 2
+#include "resample.h"
+#include "split.h"
 
 static int
 edible_size(struct plugin *pl, int frames_avail)
@@ -39,6 +42,9 @@ plugin_check_tmpbuf(struct plugin *pl, struct fmt *fmt);
 static void
 plugin_process_twobuf(struct plugin *pl, struct fmt *fmt, struct buf *data, struct buf *tmp);
 
+static void
+plugin_process_inplace(struct plugin *pl, struct fmt *fmt, struct buf *data, struct buf *tmp);
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeclaration-after-statement"
 
@@ -66,13 +72,13 @@ D	buf_free(tmp);
 	//
 	if U (edible == 0) {
 		if U (pl->opts.trace)
-			fprintf(stderr, "[%s] incoming %d frames not yet edible, adding to buffer\n",
-			    superbasename(pl->opts.path),
-			    fmt_bytes2frames(fmt, data->sz));
+			log_post(LOG_NOT_EDIBLE, pl->opts.path,
+			    fmt_bytes2frames(fmt, data->sz), 0, 0, 0);
 
 		if (pl->buf.sz == 0) {
 			buf_swap(&pl->buf, data);
 		} else {
+			pl->stats.copy_bytes += data->sz;
 			buf_append_buf(&pl->buf, data);
 			buf_clear(data);
 		}
@@ -84,49 +90,68 @@ D		buf_free(data);
 	// add old saved data to the input buffer
 	if (pl->buf.sz != 0) {
 		if U (pl->opts.trace)
-			fprintf(stderr, "[%s] took %d frames from temp. buffer, data is now %d frames\n",
-			    superbasename(pl->opts.path),
+			log_post(LOG_TOOK_BUFFERED, pl->opts.path,
 			    fmt_bytes2frames(fmt, pl->buf.sz),
-			    fmt_bytes2frames(fmt, pl->buf.sz+data->sz));
+			    fmt_bytes2frames(fmt, pl->buf.sz+data->sz), 0, 0);
 
+		pl->stats.copy_bytes += pl->buf.sz;
 		buf_prepend_buf(data, &pl->buf);
 		buf_clear(&pl->buf);
 	}
 
-	/// warning: obsolete historical comment
 	//
-	// there's two versions of the next part:
-	// - one processes the input data in-place in the same buffer. this may
-	//    be faster due to less copying
-	// - one copies the input piece-by-piece to a second buffer and
-	//    processes it there. this is safe against accidentally overwriting
-	//    parts of the input data if the plugin might stretch the sound
-	//    (writing samples past the end of the buffer given as input)
+	// the chunks are processed in place unless the plugin stretched in the
+	//  last block. in place, the only copying is of the unread input a
+	//  stretch could overwrite (none if it can't stretch, autostretch= says
+	//  it doesn't, or it's the last chunk), and of the rest of the input if
+	//  it actually does stretch
 	//
-	// the first version is used if the plugin is known not to stretch the
-	//  sound, or if the input is small enough that it can be processed in
-	//  one call (no risk of overwriting any following data)
+	// a plugin that keeps stretching would have nearly all of its input
+	//  copied twice that way, so it gets the two-buffer version instead,
+	//  which copies every chunk once
 	//
-	/// edit: the two functions have been combined. the two-buffer one has
-	///  been modified to deal with the two buffers being the same
-	/// it still has the advantage of reduced copying when it's not necessary
-
-	bool use_onebuf = false;
-	if (edible == avail) // can process all of it in one call
-		use_onebuf = true;
-	else if (!pl->opts.may_stretch) // plugin known not to stretch sound
-		use_onebuf = true;
-
-	// (randomize) if either version would work, then pick one at random
-	if U (use_onebuf && pl->opts.randomize) {
-		if (rand() % 100 >= 60)
-			use_onebuf = false;
+
+	bool use_inplace = !pl->stretched || edible == avail;
+
+	// (randomize) both work, pick one at random
+	if U (pl->opts.randomize) {
+		if (plugin_rand(pl) % 100 >= 60)
+			use_inplace = !use_inplace;
 	}
 
-	if (use_onebuf)
-		tmp = data;
+	pl->stretched = false;
 
-	plugin_process_twobuf(pl, fmt, data, tmp);
+	if (use_inplace)
+		plugin_process_inplace(pl, fmt, data, tmp);
+	else
+		plugin_process_twobuf(pl, fmt, data, tmp);
+
+	//
+	// (autostretch) most dlls never stretch but have to be assumed to. once
+	//  one that's given autostretch= has gone long enough without, stop
+	//  making guard copies for it. the buffers stay big enough for a
+	//  stretch, so if it does stretch after all it can only overwrite its
+	//  own unread input. that input is lost, which is why it's opt-in
+	//
+	if U (pl->stretched) {
+		if U (pl->nostretch)
+			log_post(LOG_STRETCH_AGAIN, pl->opts.path,
+			    pl->calm, 0, 0, 0);
+		pl->nostretch = false;
+		pl->calm = 0;
+	} else if (pl->calm < INT_MAX) {
+		pl->calm++;
+
+		if U (!pl->nostretch &&
+		      pl->opts.autostretch != 0 &&
+		      pl->opts.may_stretch &&
+		      pl->calm >= pl->opts.autostretch) {
+			if U (pl->opts.trace)
+				log_post(LOG_NOSTRETCH, pl->opts.path,
+				    pl->calm, 0, 0, 0);
+			pl->nostretch = true;
+		}
+	}
 }
 
 #pragma GCC diagnostic pop
@@ -154,15 +179,10 @@ plugin_process_twobuf(struct plugin *pl,
 D	buf_shrink_cap(data, data->sz);
 D	buf_shrink_cap(tmp, tmp->sz);
 
-	if (tmp == data) {
-		buf_prepare_capacity(tmp, data->sz*pl_stretch_factor);
-	} else {
-		buf_clear(tmp);
-		buf_prepare_append(tmp, data->res + data->sz*pl_stretch_factor);
-		buf_set_reserved(tmp, data->res);
-	}
+	buf_clear(tmp);
+	buf_prepare_append(tmp, data->res + data->sz*pl_stretch_factor);
+	buf_set_reserved(tmp, data->res);
 
-	const char *const readstart = data->p;
 	const char       *readp     = data->p;
 	const char *const readend   = data->p + data->sz;
 
@@ -187,10 +207,8 @@ D		assert(buf_boundscheck_write(tmp, writep, fs*writable));
 		readp += fs*readable;
 		writep += fs*writable;
 
-		// if they're the same buffer and the sound was stretched, skip
-		//  over the stretch tail in readp to avoid processing it twice
-		if (writestart == readstart && writep > readp)
-			readp = writep;
+		if (writable > readable)
+			pl->stretched = true;
 
 		// pointers still valid
 		// note: the check of readp is with _write because a stretch
@@ -219,12 +237,12 @@ D		assert(buf_boundscheck_write(tmp, writep, 0));
 		size_t rest_sz = readend-rest;
 
 		if U (pl->opts.trace)
-			fprintf(stderr, "[%s] leftover frames after processing: %d\n",
-			    superbasename(pl->opts.path),
-			    fmt_bytes2frames(fmt, rest_sz));
+			log_post(LOG_LEFTOVER, pl->opts.path,
+			    fmt_bytes2frames(fmt, rest_sz), 0, 0, 0);
 
 D		assert(buf_boundscheck_read(data, rest, rest_sz)&BUF_RIGHTEDGE);
 
+		pl->stats.copy_bytes += rest_sz;
 		buf_append(&pl->buf, rest, rest_sz);
 
 		plugin_check_tmpbuf(pl, fmt);
@@ -234,6 +252,115 @@ D		assert(buf_boundscheck_read(data, rest, rest_sz)&BUF_RIGHTEDGE);
 	buf_swap(data, tmp);
 }
 
+static void
+plugin_process_inplace(struct plugin *pl,
+                       struct fmt *fmt,
+                       struct buf *data,
+                       struct buf *tmp)
+{
+	const size_t fs = fmt_frame_size(fmt);
+	int pl_stretch_factor = (pl->opts.may_stretch) ? MAX_STRETCH_FACTOR : 1;
+
+D	buf_shrink_cap(data, data->sz);
+
+	buf_prepare_capacity(data, data->sz*pl_stretch_factor);
+	buf_clear(tmp);
+
+	char *const writestart = data->p;
+	char       *writep     = data->p;
+	char *const writeend   = data->p + data->cap;
+
+	// the unread input. in data until a stretch runs into it, then in tmp
+	const char *readp   = data->p;
+	const char *readend = data->p + data->sz;
+	bool moved = false;
+
+	while (readp < readend) {
+		int readable = edible_size(pl, (readend-readp)/fs);
+		int writable = (writeend-writep)/fs;
+		const char *next;
+		size_t guard = 0;
+
+		if (readable == 0)
+			break;
+		next = readp + fs*readable;
+
+		//
+		// save the input after this chunk that the output could reach.
+		//  the output starts at writep, which is behind readp if the
+		//  plugin has shrunk the sound
+		//
+		if (!moved && pl_stretch_factor > 1 && !pl->nostretch) {
+			const char *reach = writep + fs*readable*pl_stretch_factor;
+
+			if (reach > next)
+				guard = MIN((size_t)(reach-next), (size_t)(readend-next));
+			if (guard != 0) {
+				buf_clear(tmp);
+				buf_append(tmp, next, guard);
+				pl->stats.copy_bytes += guard;
+			}
+		}
+
+D		assert(buf_boundscheck_write(data, writep, fs*writable));
+
+		ModifySamples_s(pl, fmt,
+		    readp, &readable,
+		    writep, &writable);
+
+		if (readable == 0)
+			break;
+
+		readp += fs*readable;
+		writep += fs*writable;
+
+		if (writable > readable)
+			pl->stretched = true;
+
+		//
+		// it stretched into the input. the part that was there is in
+		//  tmp, put the rest after it and read from there from now on
+		//
+		if U (!moved && writep > readp) {
+			const char *rest = readp+guard;
+			size_t rest_sz;
+
+			// (past the guard only if it stretched more than it's
+			//  allowed to. that input is gone)
+			if U (writep > rest)
+				rest = MIN((const char *)writep, readend);
+			rest_sz = readend-rest;
+
+			if U (pl->opts.trace)
+				log_post(LOG_STRETCH_MOVE, pl->opts.path,
+				    fmt_bytes2frames(fmt, guard+rest_sz), 0, 0, 0);
+
+			buf_append(tmp, rest, rest_sz);
+			pl->stats.copy_bytes += rest_sz;
+
+			readp = tmp->p;
+			readend = tmp->p + tmp->sz;
+			moved = true;
+		}
+	}
+
+	// leftovers to this plugin's temp. buffer, see plugin_process_twobuf()
+	if (readp < readend) {
+		size_t rest_sz = readend-readp;
+
+		if U (pl->opts.trace)
+			log_post(LOG_LEFTOVER, pl->opts.path,
+			    fmt_bytes2frames(fmt, rest_sz), 0, 0, 0);
+
+		pl->stats.copy_bytes += rest_sz;
+		buf_append(&pl->buf, readp, rest_sz);
+
+		plugin_check_tmpbuf(pl, fmt);
+	}
+
+	buf_set_size(data, writep-writestart);
+}
+
 #pragma GCC diagnostic pop
 
 // the s stands for silly
@@ -266,50 +393,62 @@ ModifySamples_s(struct plugin *pl,
 		return;
 	}
 
-	if (outbuf != inbuf)
+	if (outbuf != inbuf) {
 		memmove(outbuf, inbuf, fs**inbuf_frames);
+		pl->stats.copy_bytes += fs**inbuf_frames;
+	}
 
-	if U (pl->opts.trace)
-		fprintf(stderr, "[%s] ModifySamples %d",
-		    superbasename(pl->opts.path),
-		    *inbuf_frames);
-
-	plug_rv = pl->module->ModifySamples(pl->module,
-	    (short int *)outbuf,
-	    *inbuf_frames,
-	    fmt->bps,
-	    fmt->ch,
-	    fmt->rate);
+	if U (pl->rs != NULL)
+		plug_rv = resample_modify_samples(pl, fmt, outbuf, *inbuf_frames, pl_stretch_factor);
+	else
+		plug_rv = plugin_modify_samples(pl, fmt, outbuf, *inbuf_frames, pl_stretch_factor);
 
 	if U (pl->opts.trace)
-		fprintf(stderr, " -> %d\n",
-		    plug_rv);
+		log_post(LOG_MODIFYSAMPLES, pl->opts.path,
+		    *inbuf_frames, plug_rv, 0, 0);
 
 	if U (plug_rv < 0) {
-		fprintf(stderr, "warning: ModifySamples() for plugin %s returned %d\n",
-		    superbasename(pl->opts.path),
-		    plug_rv);
+		log_post(LOG_BAD_RETURN, pl->opts.path,
+		    plug_rv, 0, 0, 0);
 		plug_rv = 0;
 	}
 
 	if U (plug_rv > *inbuf_frames*pl_stretch_factor) {
-		fprintf(stderr, "warning: %.1fx stretch (%d -> %d) by plugin %s is above %s %d\n",
-		    (float)plug_rv / (float)*inbuf_frames,
+		log_post(LOG_OVERSTRETCH, pl->opts.path,
 		    *inbuf_frames, plug_rv,
-		    superbasename(pl->opts.path),
-		    (pl->opts.may_stretch) ?
-		        "MAX_STRETCH_FACTOR" :
-		        "its allowed stretch factor",
-		    pl_stretch_factor);
+		    pl_stretch_factor,
+		    pl->opts.may_stretch);
 	}
 
 	assert(plug_rv <= *outbuf_frames);
 
+	pl->stats.calls++;
+	pl->stats.frames_in += *inbuf_frames;
+	pl->stats.frames_out += plug_rv;
+
 	*outbuf_frames = plug_rv;
 
 	return;
 }
 
+int
+plugin_modify_samples(struct plugin *pl,
+                      struct fmt *fmt,
+                      char *samples,
+                      int frames,
+                      int stretch_factor)
+{
+	if U (pl->split != NULL && split_groups(pl, fmt) != 0)
+		return split_modify_samples(pl, fmt, samples, frames, stretch_factor);
+
+	return pl->module->ModifySamples(pl->module,
+	    (short int *)samples,
+	    frames,
+	    fmt->bps,
+	    fmt->ch,
+	    fmt->rate);
+}
+
 //
 // memory leak avoidance
 //
@@ -322,13 +461,15 @@ plugin_check_tmpbuf(struct plugin *pl,
 
 	if (pl->buf.sz > pl->lastbufsz) {
 		if U (pl->lastbufsz <= onesec && pl->buf.sz > onesec) {
-			fprintf(stderr, "warning: temp. buffer of plugin %s exceeds one second. is it working properly?\n",
-			    superbasename(pl->opts.path));
+			log_post(LOG_TMPBUF_LARGE, pl->opts.path,
+			    0, 0, 0, 0);
 		}
 
 		if U (pl->lastbufsz <= 5*onesec && pl->buf.sz > 5*onesec) {
+			log_deinit();
 			fprintf(stderr, "error: temp. buffer of plugin %s exceeds five seconds. aborting now to stop the memory leak\n",
 			    superbasename(pl->opts.path));
+			flight_dump("temp. buffer exceeds five seconds");
 			abort();
 		}
 	}
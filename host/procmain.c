@@ -1,12 +1,17 @@
 #include "procmain.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "../plugin/ddw.h"
 
+#include "chain.h"
+#include "flight.h"
 #include "macros.h"
 #include "main.h"
+#include "memlock.h"
 #include "misc.h"
+#include "sched.h"
 
 DWORD WINAPI
 process_thread_main(void *ud)
@@ -15,13 +20,22 @@ process_thread_main(void *ud)
 	struct buf tmp = {0};
 	struct fmt fmt = {0};
 	struct fmt oldfmt = {0};
-	size_t restotal;
 	int thread_rv = 0;
+
+	// the last silence came out as silence and the chain keeps it that way.
+	//  more silence can be answered without running it
+	bool quiet = false;
 	(void)ud;
 
+	sched_setup_thread();
+	memlock_setup_thread();
+
 	for (;;) {
 		struct processing_request req;
 		struct processing_response res;
+		struct flight_host_rec *fr;
+		uint32_t faults = 0;
+		bool silent;
 
 		if U (!read_full(in_fd, &req, sizeof(req))) {
 			if U (errno != 0)
@@ -31,6 +45,32 @@ process_thread_main(void *ud)
 			break;
 		}
 
+		//
+		// reset or flush: nothing follows, and nothing goes back. a flush
+		//  uses the format the chain is set up for, if there is one yet
+		//
+		if U (req.command != DDW_CMD_PROCESS && req.command != DDW_CMD_SILENCE) {
+			assert(req.command == DDW_CMD_RESET || req.command == DDW_CMD_FLUSH);
+			assert(req.buffer_size == 0);
+
+			// (the dlls still have whatever they had inside)
+			quiet = false;
+
+			if (req.command == DDW_CMD_FLUSH && fmt_makes_sense(&oldfmt))
+				chain_flush(&oldfmt, (uint64_t)req.flush_ms*oldfmt.rate/1000, &data, &tmp);
+			else
+				chain_reset();
+
+			res = (struct processing_response){
+				.buffer_size = 0,
+				.latency_frames = fmt_makes_sense(&oldfmt) ? chain_latency_frames(&oldfmt) : 0,
+			};
+			if U (!write_full(out_fd, &res, sizeof(res)))
+				goto writeerr;
+
+			continue;
+		}
+
 		fmt = (struct fmt){
 			.rate = req.samplerate,
 			.bps = req.bitspersample,
@@ -40,95 +80,85 @@ process_thread_main(void *ud)
 		assert(fmt_makes_sense(&fmt));
 		assert(req.buffer_size % fmt_frame_size(&fmt) == 0);
 
-		if U (!fmt_same(&fmt, &oldfmt)) {
-			bool warn = false;
-			const char *what;
+		silent = (req.command == DDW_CMD_SILENCE);
+
+		if (silent && quiet && fmt_same(&fmt, &oldfmt)) {
+			res = (struct processing_response){
+				.buffer_size = req.buffer_size,
+				.latency_frames = chain_latency_frames(&fmt),
+				.silent = 1,
+				.inactive = chain_inactive(),
+				.nocache = !chain_cacheable(),
+			};
+			if U (!write_full(out_fd, &res, sizeof(res)))
+				goto writeerr;
+
+			continue;
+		}
 
+		fr = flight_host_begin();
+		if U (memlock_count)
+			faults = memlock_faults();
+		fr->rate = fmt.rate;
+		fr->bps = fmt.bps;
+		fr->ch = fmt.ch;
+		fr->nplugins = plugins_cnt;
+		fr->bytes_in = req.buffer_size;
+
+		if U (!fmt_same(&fmt, &oldfmt)) {
 			fprintf(stderr, "format change: rate=%d bps=%d ch=%d\n",
 			    fmt.rate, fmt.bps, fmt.ch);
 
-			for (unsigned int i = 0; i < plugins_cnt; i++) {
-				if (plugins[i].buf.sz != 0) {
-					plugins[i].buf.sz = 0;
-					warn = true;
-				}
-
-				//
-				// re-check compatibility
-				//
-				plugins[i].skip = false;
-				what = plugin_supports_format(&plugins[i], &fmt);
-				if (what != NULL) {
-					if (plugins[i].opts.required) {
-						fprintf(stderr, "error: required plugin %s doesn't support this %s, exiting\n",
-						    superbasename(plugins[i].opts.path),
-						    what);
-						goto err;
-					}
-					fprintf(stderr, "warning: disabling %s due to unsupported %s\n",
-					    superbasename(plugins[i].opts.path),
-					    what);
-					plugins[i].skip = true;
-				}
-			}
-			if (warn)
-				fprintf(stderr, "warning: threw out buffered data due to format change\n");
+			if U (!chain_set_format(&fmt))
+				goto err;
+			if U (chain_inactive())
+				fprintf(stderr, "no plugins run at this format, the dsp can bypass the host\n");
 
 			oldfmt = fmt;
 		}
 
-		restotal = 0;
-		for (unsigned int i = 0; i < plugins_cnt; i++) {
-			if (!plugins[i].skip)
-				restotal += plugins[i].buf.sz;
-		}
-
-		buf_clear(&data);
-		buf_prepare_append(&data, restotal+req.buffer_size);
-		buf_set_reserved(&data, restotal);
+		chain_prepare_input(&data, req.buffer_size);
 
-		if U (!read_full(in_fd, data.p, req.buffer_size))
+		if (silent)
+			memset(data.p, 0, req.buffer_size);
+		else if U (!read_full(in_fd, data.p, req.buffer_size))
 			goto readerr;
 
 		buf_register_append(&data, req.buffer_size);
 
-		for (unsigned int i = 0; i < plugins_cnt; i++) {
-			size_t oldtmpsz, oldres, resused;
-
-			if (plugins[i].skip)
-				continue;
-
-			oldtmpsz = plugins[i].buf.sz;
-			oldres = data.res;
-
-			procidx = i;
-			plugin_process(&plugins[i], &fmt, &data, &tmp);
-
-			resused = oldres-data.res;
-
-			// plugin used either 0 reserved space OR the exact old
-			//  size of its tmp buffer
-D			assert(resused == 0 || resused == oldtmpsz);
-
-			if (data.sz == 0)
-				break;
-		}
-		procidx = -1;
+		chain_process(&fmt, &data, &tmp, fr);
+		if U (memlock_count)
+			fr->faults = memlock_faults()-faults;
+		flight_host_commit();
 
+		//
+		// silence that comes out as silence goes back as just the header
+		//  too. if it's not empty and no plugin can have a tail, the
+		//  next silence doesn't need to go through the chain at all
+		//
 		res = (struct processing_response){
 			.buffer_size = data.sz,
+			.latency_frames = chain_latency_frames(&fmt),
+			.silent = silent && is_zero(data.p, data.sz),
+			.inactive = chain_inactive(),
+			.nocache = !chain_cacheable(),
 		};
+		quiet = res.silent && data.sz != 0 && chain_keeps_silence();
+
 		if U (!write_full(out_fd, &res, sizeof(res)))
 			goto writeerr;
 
 		if L (data.sz != 0) {
-			if U (!write_full(out_fd, data.p, data.sz))
-				goto writeerr;
+			if L (!res.silent) {
+				if U (!write_full(out_fd, data.p, data.sz))
+					goto writeerr;
+			}
 
 			buf_clear(&data);
 		}
 	}
 out:
+	sched_teardown_thread();
 	buf_free(&data);
 	buf_free(&tmp);
 	PostThreadMessage(main_tid, WM_QUIT,
@@ -0,0 +1,490 @@
+#include "render.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buf.h"
+#include "chain.h"
+#include "macros.h"
+#include "main.h"
+#include "misc.h"
+
+// the input is mapped this much at a time
+#define RENDER_VIEW_SZ (64*1024*1024)
+
+// frames per chain_process() call. the plugins still get what their options
+//  allow, this only decides how often the output is written out
+#define RENDER_BLOCK_FRAMES 16384
+
+#define RENDER_OUTBUF_SZ (4*1024*1024)
+
+#define WAVE_FORMAT_PCM        0x0001
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+struct __attribute__((packed)) wav_fmt {
+	uint16_t format;
+	uint16_t channels;
+	uint32_t rate;
+	uint32_t byterate;
+	uint16_t blockalign;
+	uint16_t bits;
+};
+
+struct __attribute__((packed)) wav_fmt_ext {
+	struct wav_fmt wf; // .format is WAVE_FORMAT_EXTENSIBLE
+	uint16_t cbsize;
+	uint16_t validbits;
+	uint32_t chmask;
+	uint16_t subformat; // first 2 bytes of the guid
+};
+
+struct __attribute__((packed)) wav_header {
+	char riff[4];
+	uint32_t riffsz;
+	char wave[4];
+	char fmt[4];
+	uint32_t fmtsz;
+	struct wav_fmt wf;
+	char data[4];
+	uint32_t datasz;
+};
+
+// -----------------------------------------------------------------------------
+
+struct input {
+	HANDLE file;
+	HANDLE mapping;
+	unsigned long long filesz;
+	DWORD granularity;
+
+	const char *view;
+	unsigned long long view_off;
+	size_t view_sz;
+};
+
+static bool
+input_open(struct input *self, const char *path)
+{
+	LARGE_INTEGER sz;
+	SYSTEM_INFO si;
+
+	*self = (struct input){.file = INVALID_HANDLE_VALUE};
+
+	self->file = CreateFile(path,
+	                        GENERIC_READ,
+	                        FILE_SHARE_READ,
+	                        NULL,
+	                        OPEN_EXISTING,
+	                        FILE_FLAG_SEQUENTIAL_SCAN,
+	                        NULL);
+	if (self->file == INVALID_HANDLE_VALUE) {
+		PrintError("CreateFile");
+		return false;
+	}
+
+	if (!GetFileSizeEx(self->file, &sz)) {
+		PrintError("GetFileSizeEx");
+		return false;
+	}
+	self->filesz = sz.QuadPart;
+
+	// can't map an empty file
+	if (self->filesz == 0)
+		return true;
+
+	self->mapping = CreateFileMapping(self->file,
+	                                  NULL,
+	                                  PAGE_READONLY,
+	                                  0,
+	                                  0,
+	                                  NULL);
+	if (self->mapping == NULL) {
+		PrintError("CreateFileMapping");
+		return false;
+	}
+
+	GetSystemInfo(&si);
+	self->granularity = si.dwAllocationGranularity;
+
+	return true;
+}
+
+static void
+input_close(struct input *self)
+{
+	if (self->view != NULL)
+		UnmapViewOfFile(self->view);
+	if (self->mapping != NULL)
+		CloseHandle(self->mapping);
+	if (self->file != INVALID_HANDLE_VALUE)
+		CloseHandle(self->file);
+
+	*self = (struct input){.file = INVALID_HANDLE_VALUE};
+}
+
+//
+// get a pointer to at least min(want, rest of the file) bytes at off
+//  (want must be less than RENDER_VIEW_SZ - granularity)
+//
+static const char *
+input_at(struct input *self, unsigned long long off, size_t want)
+{
+	unsigned long long base;
+	size_t sz;
+
+	want = MIN(want, self->filesz-off);
+
+	if (self->view != NULL &&
+	    off >= self->view_off &&
+	    off+want <= self->view_off+self->view_sz)
+		return self->view+(off-self->view_off);
+
+	if (self->view != NULL) {
+		UnmapViewOfFile(self->view);
+		self->view = NULL;
+	}
+
+	base = off-off%self->granularity;
+	sz = MIN((unsigned long long)RENDER_VIEW_SZ, self->filesz-base);
+
+	self->view = MapViewOfFile(self->mapping,
+	                           FILE_MAP_READ,
+	                           (DWORD)(base >> 32),
+	                           (DWORD)base,
+	                           sz);
+	if (self->view == NULL) {
+		PrintError("MapViewOfFile");
+		return NULL;
+	}
+	self->view_off = base;
+	self->view_sz = sz;
+
+	return self->view+(off-base);
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// find the format and the data chunk. returns false if it isn't a wav file
+//  at all, sets fmt->rate to 0 if it is but can't be used
+//
+static bool
+wav_parse(struct input *in, struct fmt *fmt,
+          unsigned long long *data_off, unsigned long long *data_sz)
+{
+	const char *p;
+	unsigned long long off = 12;
+	bool have_fmt = false;
+
+	if (in->filesz < 12)
+		return false;
+	p = input_at(in, 0, 12);
+	if (p == NULL || memcmp(p, "RIFF", 4) != 0 || memcmp(p+8, "WAVE", 4) != 0)
+		return false;
+
+	fmt->rate = 0;
+
+	while (off+8 <= in->filesz) {
+		uint32_t ckid_sz;
+		char ckid[4];
+
+		p = input_at(in, off, 8);
+		if (p == NULL)
+			return true;
+		memcpy(ckid, p, 4);
+		memcpy(&ckid_sz, p+4, 4);
+		off += 8;
+
+		if (memcmp(ckid, "fmt ", 4) == 0 && ckid_sz >= 16) {
+			struct wav_fmt_ext ext = {0};
+			struct wav_fmt *wf = &ext.wf;
+
+			p = input_at(in, off, sizeof(ext));
+			if (p == NULL)
+				return true;
+			memcpy(&ext, p, MIN((size_t)ckid_sz, sizeof(ext)));
+
+			if (wf->format == WAVE_FORMAT_EXTENSIBLE && ckid_sz >= sizeof(ext))
+				wf->format = ext.subformat;
+			if (wf->format != WAVE_FORMAT_PCM) {
+				fprintf(stderr, "render: only integer pcm wav files are supported (format 0x%04x)\n",
+				    wf->format);
+				return true;
+			}
+
+			*fmt = (struct fmt){
+				.rate = wf->rate,
+				.bps = wf->bits,
+				.ch = wf->channels,
+			};
+			have_fmt = true;
+		} else if (memcmp(ckid, "data", 4) == 0) {
+			if (!have_fmt) {
+				fprintf(stderr, "render: wav data chunk before fmt chunk\n");
+				fmt->rate = 0;
+				return true;
+			}
+			*data_off = off;
+			// streamed wavs have 0 or -1 here, and anything past the end
+			//  of the file is just cut off
+			if (ckid_sz == 0 || ckid_sz == UINT32_MAX || off+ckid_sz > in->filesz)
+				ckid_sz = MIN(in->filesz-off, (unsigned long long)UINT32_MAX);
+			*data_sz = ckid_sz;
+			return true;
+		}
+
+		off += ckid_sz+(ckid_sz&1);
+	}
+
+	fprintf(stderr, "render: no data chunk in wav file\n");
+	fmt->rate = 0;
+	return true;
+}
+
+static bool
+wav_write_header(FILE *f, const struct fmt *fmt, unsigned long long datasz)
+{
+	struct wav_header h;
+	size_t frame = fmt_frame_size(fmt);
+
+	datasz = MIN(datasz, (unsigned long long)UINT32_MAX-sizeof(h));
+
+	memcpy(h.riff, "RIFF", 4);
+	h.riffsz = sizeof(h)-8+datasz;
+	memcpy(h.wave, "WAVE", 4);
+	memcpy(h.fmt, "fmt ", 4);
+	h.fmtsz = 16;
+	h.wf = (struct wav_fmt){
+		.format = WAVE_FORMAT_PCM,
+		.channels = fmt->ch,
+		.rate = fmt->rate,
+		.byterate = fmt->rate*frame,
+		.blockalign = frame,
+		.bits = fmt->bps,
+	};
+	memcpy(h.data, "data", 4);
+	h.datasz = datasz;
+
+	return fwrite(&h, sizeof(h), 1, f) == 1;
+}
+
+static bool
+ends_with(const char *s, const char *suffix)
+{
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && strcasecmp(s+n-m, suffix) == 0;
+}
+
+// -----------------------------------------------------------------------------
+
+bool
+render_file(const char *in_path, const char *out_path, const struct fmt *rawfmt)
+{
+	struct input in;
+	FILE *out = NULL;
+	struct fmt fmt = {0};
+	struct buf data = {0};
+	struct buf tmp = {0};
+	unsigned long long data_off = 0, data_sz = 0;
+	unsigned long long pos, written = 0;
+	unsigned long long frames_in = 0, frames_out = 0;
+	bool wav_out = ends_with(out_path, ".wav");
+	size_t frame, carry = 0;
+	uint64_t tail;
+	uint64_t t0, t1;
+	bool ok = false;
+
+	if (!input_open(&in, in_path))
+		goto out;
+
+	if (wav_parse(&in, &fmt, &data_off, &data_sz)) {
+		if (fmt.rate == 0)
+			goto out;
+	} else if (rawfmt != NULL) {
+		fmt = *rawfmt;
+		data_sz = in.filesz;
+	} else {
+		fprintf(stderr, "render: %s isn't a wav file, give the format with --render=rate,bits,ch\n",
+		    in_path);
+		goto out;
+	}
+
+	if (!fmt_makes_sense(&fmt)) {
+		fprintf(stderr, "render: unsupported format %d Hz, %d bit, %d ch\n",
+		    fmt.rate, fmt.bps, fmt.ch);
+		goto out;
+	}
+
+	if (!chain_set_format(&fmt))
+		goto out;
+
+	out = fopen(out_path, "wb");
+	if (out == NULL) {
+		perror("render: fopen");
+		goto out;
+	}
+	setvbuf(out, NULL, _IOFBF, RENDER_OUTBUF_SZ);
+
+	// placeholder, the sizes are filled in at the end
+	if (wav_out && !wav_write_header(out, &fmt, 0)) {
+		perror("render: fwrite");
+		goto out;
+	}
+
+	frame = fmt_frame_size(&fmt);
+	data_sz -= data_sz%frame;
+
+	t0 = now_ns();
+
+	for (pos = 0; pos < data_sz; ) {
+		size_t sz = MIN(fmt_frames2bytes(&fmt, RENDER_BLOCK_FRAMES), data_sz-pos);
+		const char *p = input_at(&in, data_off+pos, sz);
+
+		if (p == NULL)
+			goto out;
+
+		// the input goes straight from the mapping to the chain's buffer,
+		//  there's nothing to gain from processing it in place since the
+		//  plugins may need to prepend to it anyway
+		chain_prepare_input(&data, sz);
+		memcpy(data.p, p, sz);
+		buf_register_append(&data, sz);
+
+		chain_process(&fmt, &data, &tmp, NULL);
+
+		if (data.sz > 0 && fwrite(data.p, 1, data.sz, out) != data.sz) {
+			perror("render: fwrite");
+			goto out;
+		}
+
+		frames_in += sz/frame;
+		frames_out += fmt_bytes2frames(&fmt, data.sz);
+		written += data.sz;
+		pos += sz;
+	}
+
+	//
+	// the end of the input is still in the plugins' delay lines and temp.
+	//  buffers. push it out with silence like chain_flush() does, or every
+	//  file would be cut short by the chain's latency
+	//
+	tail = chain_latency_frames(&fmt);
+	for (unsigned int i = 0; i < plugins_cnt; i++)
+		tail += fmt_bytes2frames(&fmt, plugins[i].buf.sz);
+
+	while (tail > 0) {
+		size_t sz = fmt_frames2bytes(&fmt, MIN(tail, RENDER_BLOCK_FRAMES));
+
+		chain_prepare_input(&data, sz);
+		memset(data.p, 0, sz);
+		buf_register_append(&data, sz);
+
+		chain_process(&fmt, &data, &tmp, NULL);
+
+		if (data.sz > 0 && fwrite(data.p, 1, data.sz, out) != data.sz) {
+			perror("render: fwrite");
+			goto out;
+		}
+
+		frames_out += fmt_bytes2frames(&fmt, data.sz);
+		written += data.sz;
+		tail -= sz/frame;
+	}
+
+	t1 = now_ns();
+
+	if (wav_out) {
+		if (fflush(out) != 0 ||
+		    fseek(out, 0, SEEK_SET) != 0 ||
+		    !wav_write_header(out, &fmt, written)) {
+			perror("render: updating wav header");
+			goto out;
+		}
+		if (written > UINT32_MAX-sizeof(struct wav_header))
+			fprintf(stderr, "render: warning: output is too big for a wav file, the header is wrong\n");
+	}
+
+	if (fclose(out) != 0) {
+		out = NULL;
+		perror("render: fclose");
+		goto out;
+	}
+	out = NULL;
+
+	for (unsigned int i = 0; i < plugins_cnt; i++)
+		carry += plugins[i].buf.sz;
+	if (carry > 0)
+		fprintf(stderr, "render: warning: %zu bytes were still buffered by the plugins at the end\n",
+		    carry);
+
+	fprintf(stderr, "render: %llu frames in, %llu frames out, %.3f s for %.3f s of audio (%.1fx real time)\n",
+	    frames_in, frames_out,
+	    (t1-t0)/1e9,
+	    (double)frames_in/fmt.rate,
+	    (t1 > t0) ? (double)frames_in/fmt.rate/((t1-t0)/1e9) : 0.0);
+
+	ok = true;
+out:
+	if (out != NULL)
+		fclose(out);
+	input_close(&in);
+	buf_free(&data);
+	buf_free(&tmp);
+
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+static bool
+reset_chain(void)
+{
+	chain_reset();
+
+	for (unsigned int i = 0; i < plugins_cnt; i++) {
+		if (!plugin_restart(&plugins[i]))
+			return false;
+	}
+
+	return true;
+}
+
+bool
+render_batch(FILE *in, FILE *out, const struct fmt *rawfmt)
+{
+	char line[2*4096];
+	unsigned int n = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char *tab, *nl;
+		bool ok;
+
+		nl = strchr(line, '\n');
+		tab = strchr(line, '\t');
+		if (nl == NULL || tab == NULL) {
+			fprintf(stderr, "render: bad job line \"%s\"\n", line);
+			return false;
+		}
+		*nl = '\0';
+		*tab = '\0';
+
+		// (the first file gets the plugins as they were loaded)
+		if (n++ > 0 && !reset_chain()) {
+			fputs("error\n", out);
+			fflush(out);
+			return false;
+		}
+
+		ok = render_file(line, tab+1, rawfmt);
+
+		fputs(ok ? "ok\n" : "error\n", out);
+		if (fflush(out) != 0) {
+			perror("render: fflush");
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "fmt.h"
+
+//
+// --render: run a file through plugins[] as fast as possible instead of
+//  serving the pipe
+//
+// the input is a wav file (16/24/32-bit pcm) or raw pcm in the format given
+//  with rawfmt. the output is a wav file if its name ends with .wav, raw pcm
+//  otherwise. it has the chain's latency worth of silence run through at the
+//  end, so nothing the plugins held on to is lost
+//
+bool
+render_file(const char *in, const char *out, const struct fmt *rawfmt);
+
+//
+// --render-batch: render_file() for every "input\toutput\n" line read from
+//  `in`, answering each with "ok\n" or "error\n" on `out`. the plugins are
+//  restarted between files so nothing carries over from the previous one
+//
+// used by ddw_batch (tools/) to keep a pool of hosts running
+//
+bool
+render_batch(FILE *in, FILE *out, const struct fmt *rawfmt);
@@ -0,0 +1,496 @@
+#include "resample.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+ #include <xmmintrin.h>
+ #define RESAMPLE_SSE
+#endif
+
+#include "conv.h"
+#include "macros.h"
+#include "memlock.h"
+#include "misc.h"
+
+// zero frames the output starts with, so the ±1 frame jitter of the two
+//  stages never leaves it short
+#define RESAMPLE_SLACK_FRAMES 4
+
+// of the lower rate's nyquist frequency
+#define RESAMPLE_PASSBAND 0.92
+
+struct rs_stage {
+	unsigned int up, down;
+	unsigned int taps;
+	unsigned int ch;
+
+	// [up][taps], reversed so they line up with the history
+	float *coefs;
+
+	// input history, one row of `cap` frames per channel so the inner loop
+	//  is a plain dot product
+	float *hist;
+	size_t cap;
+	size_t n;
+
+	// the next output is from frames idx-taps+1 .. idx, at phase `frac`
+	size_t idx;
+	unsigned int frac;
+};
+
+struct resampler {
+	struct rs_stage down; // to the plugin's rate
+	struct rs_stage up;   // and back
+
+	// interleaved scratch space
+	float *a, *b;
+	size_t ab_cap; // samples
+
+	// what the plugin gets, at its bit depth
+	struct buf pcm;
+
+	// output that hasn't been given back yet, interleaved
+	float *fifo;
+	size_t fifo_n; // frames
+	size_t fifo_cap; // samples
+};
+
+// -----------------------------------------------------------------------------
+
+static unsigned int
+gcd(unsigned int a, unsigned int b)
+{
+	while (b != 0) {
+		unsigned int t = a%b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+static bool
+grow_floats(float **p, size_t *cap, size_t need)
+{
+	float *newp;
+
+	if L (*cap >= need)
+		return true;
+
+	need = MAX(need, *cap*2);
+	memlock_unlock(*p, *cap*sizeof(float));
+	newp = realloc(*p, need*sizeof(float));
+	if (newp == NULL)
+		return false;
+	memlock_region(newp, need*sizeof(float));
+
+	*p = newp;
+	*cap = need;
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+
+static size_t
+stage_max_out(const struct rs_stage *s, size_t frames)
+{
+	return (frames*s->up+s->down-1)/s->down+1;
+}
+
+static bool
+stage_reserve(struct rs_stage *s, size_t frames)
+{
+	float *newp;
+	size_t newcap;
+
+	if L (s->cap >= frames)
+		return true;
+
+	newcap = MAX(frames, s->cap*2);
+	newp = malloc(newcap*s->ch*sizeof(float));
+	if (newp == NULL)
+		return false;
+	memlock_region(newp, newcap*s->ch*sizeof(float));
+
+	for (unsigned int c = 0; c < s->ch; c++)
+		memcpy(newp+c*newcap, s->hist+c*s->cap, s->n*sizeof(float));
+
+	memlock_unlock(s->hist, s->cap*s->ch*sizeof(float));
+	free(s->hist);
+	s->hist = newp;
+	s->cap = newcap;
+
+	return true;
+}
+
+static void
+stage_reset(struct rs_stage *s)
+{
+	memset(s->hist, 0, s->cap*s->ch*sizeof(float));
+	s->n = s->taps-1;
+	s->idx = s->taps-1;
+	s->frac = 0;
+}
+
+static bool
+stage_init(struct rs_stage *s, int from, int to, unsigned int taps, int ch)
+{
+	unsigned int g = gcd(from, to);
+	size_t len;
+	double fc, center;
+
+	*s = (struct rs_stage){
+		.up = to/g,
+		.down = from/g,
+		.taps = taps,
+		.ch = ch,
+	};
+
+	//
+	// the prototype filter runs at up*from, so the cutoff is the lower
+	//  rate's nyquist frequency in cycles per sample at that rate
+	//
+	len = (size_t)taps*s->up;
+	fc = RESAMPLE_PASSBAND*MIN(from, to)/(2.0*s->up*from);
+	center = (len-1)/2.0;
+
+	s->coefs = malloc(len*sizeof(float));
+	if (s->coefs == NULL)
+		return false;
+
+	for (size_t k = 0; k < len; k++) {
+		double x = k-center;
+		double sinc = (x == 0) ? 1.0 : sin(2*M_PI*fc*x)/(2*M_PI*fc*x);
+		double w = 0.42-0.5*cos(2*M_PI*k/(len-1))+0.08*cos(4*M_PI*k/(len-1));
+		unsigned int p = k%s->up, j = k/s->up;
+
+		// times up for the gain lost to the zero stuffing
+		s->coefs[p*taps+(taps-1-j)] = (float)(s->up*2*fc*sinc*w);
+	}
+	memlock_region(s->coefs, len*sizeof(float));
+
+	// start with a history of silence
+	if (!stage_reserve(s, taps))
+		return false;
+	stage_reset(s);
+
+	return true;
+}
+
+static void
+stage_free(struct rs_stage *s)
+{
+	memlock_unlock(s->coefs, (size_t)s->taps*s->up*sizeof(float));
+	memlock_unlock(s->hist, s->cap*s->ch*sizeof(float));
+	free(s->coefs);
+	free(s->hist);
+	*s = (struct rs_stage){0};
+}
+
+//
+// feeds it `frames` frames and writes what comes out to `out`, which must have
+//  room for stage_max_out() frames
+//
+// the filter itself is in stage_filter_c() and stage_filter_sse(). gcc
+//  can't vectorize the scalar one for i686 (x87 math, and a float sum can't
+//  be reordered without -ffast-math), so sse is done by hand and picked at
+//  runtime
+//
+static size_t
+stage_filter_c(struct rs_stage *s, float *out)
+{
+	const unsigned int ch = s->ch, taps = s->taps;
+	size_t produced = 0;
+
+	while (s->idx < s->n) {
+		const float *h = s->coefs+s->frac*taps;
+		size_t start = s->idx+1-taps;
+
+		for (unsigned int c = 0; c < ch; c++) {
+			const float *x = s->hist+c*s->cap+start;
+			float acc = 0;
+
+			for (unsigned int j = 0; j < taps; j++)
+				acc += h[j]*x[j];
+
+			out[produced*ch+c] = acc;
+		}
+		produced++;
+
+		s->frac += s->down;
+		s->idx += s->frac/s->up;
+		s->frac %= s->up;
+	}
+
+	return produced;
+}
+
+#ifdef RESAMPLE_SSE
+
+//
+// same thing four taps at a time. taps is always a multiple of 8 (see
+//  resample_setup()). nothing here is aligned, malloc() only gives 8 bytes
+//  on i686 and the history starts anywhere
+//
+__attribute__((target("sse")))
+static size_t
+stage_filter_sse(struct rs_stage *s, float *out)
+{
+	const unsigned int ch = s->ch, taps = s->taps;
+	size_t produced = 0;
+
+	while (s->idx < s->n) {
+		const float *h = s->coefs+s->frac*taps;
+		size_t start = s->idx+1-taps;
+
+		for (unsigned int c = 0; c < ch; c++) {
+			const float *x = s->hist+c*s->cap+start;
+			__m128 acc0 = _mm_setzero_ps();
+			__m128 acc1 = _mm_setzero_ps();
+			float sum[4];
+
+			for (unsigned int j = 0; j < taps; j += 8) {
+				acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(h+j), _mm_loadu_ps(x+j)));
+				acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(h+j+4), _mm_loadu_ps(x+j+4)));
+			}
+			_mm_storeu_ps(sum, _mm_add_ps(acc0, acc1));
+
+			out[produced*ch+c] = (sum[0]+sum[1])+(sum[2]+sum[3]);
+		}
+		produced++;
+
+		s->frac += s->down;
+		s->idx += s->frac/s->up;
+		s->frac %= s->up;
+	}
+
+	return produced;
+}
+
+static bool
+have_sse(void)
+{
+	static int have = -1;
+
+	if U (have == -1) {
+		__builtin_cpu_init();
+		have = __builtin_cpu_supports("sse");
+	}
+
+	return have;
+}
+
+#endif
+
+static size_t
+stage_process(struct rs_stage *s, const float *in, size_t frames, float *out)
+{
+	const unsigned int ch = s->ch, taps = s->taps;
+	size_t produced;
+	size_t keep_from;
+
+	if U (!stage_reserve(s, s->n+frames))
+		assert(!"stage_process: malloc");
+
+	for (unsigned int c = 0; c < ch; c++) {
+		float *row = s->hist+c*s->cap+s->n;
+		for (size_t f = 0; f < frames; f++)
+			row[f] = in[f*ch+c];
+	}
+	s->n += frames;
+
+#ifdef RESAMPLE_SSE
+	if L (have_sse())
+		produced = stage_filter_sse(s, out);
+	else
+#endif
+		produced = stage_filter_c(s, out);
+
+	// drop the history that won't be needed anymore. idx can be past the
+	//  end when downsampling, then the next input starts partly consumed
+	keep_from = MIN(s->idx+1-taps, s->n);
+	if (keep_from > 0) {
+		for (unsigned int c = 0; c < ch; c++) {
+			float *row = s->hist+c*s->cap;
+			memmove(row, row+keep_from, (s->n-keep_from)*sizeof(float));
+		}
+		s->n -= keep_from;
+		s->idx -= keep_from;
+	}
+
+	return produced;
+}
+
+// -----------------------------------------------------------------------------
+
+bool
+resample_setup(struct plugin *pl, const struct fmt *fmt, int rate)
+{
+	struct resampler *rs;
+	int q = MIN(MAX(pl->opts.resample, 1), RESAMPLE_QUALITY_MAX);
+	unsigned int taps = 8u<<(q-1);
+	size_t mid_max, out_max;
+	double latency;
+
+	resample_free(pl);
+
+	rs = calloc(1, sizeof(*rs));
+	if (rs == NULL) {
+		perror("calloc");
+		return false;
+	}
+	pl->rs = rs;
+	pl->rate = rate;
+
+	if (!stage_init(&rs->down, fmt->rate, rate, taps, fmt->ch) ||
+	    !stage_init(&rs->up, rate, fmt->rate, taps, fmt->ch))
+		goto err;
+
+	// everything for a block of RESAMPLE_PREALLOC_FRAMES, stretched
+	mid_max = stage_max_out(&rs->down, RESAMPLE_PREALLOC_FRAMES);
+	out_max = stage_max_out(&rs->up, mid_max*MAX_STRETCH_FACTOR);
+
+	if (!stage_reserve(&rs->down, taps+RESAMPLE_PREALLOC_FRAMES) ||
+	    !stage_reserve(&rs->up, taps+mid_max*MAX_STRETCH_FACTOR) ||
+	    !grow_floats(&rs->a, &rs->ab_cap, MAX(RESAMPLE_PREALLOC_FRAMES, mid_max*MAX_STRETCH_FACTOR)*fmt->ch))
+		goto err;
+	rs->b = malloc(rs->ab_cap*sizeof(float));
+	if (rs->b == NULL)
+		goto err;
+	memlock_region(rs->b, rs->ab_cap*sizeof(float));
+	buf_prepare_capacity(&rs->pcm, fmt_frames2bytes(fmt, mid_max*MAX_STRETCH_FACTOR));
+
+	rs->fifo_cap = (out_max+RESAMPLE_SLACK_FRAMES)*fmt->ch;
+	rs->fifo = calloc(rs->fifo_cap, sizeof(float));
+	if (rs->fifo == NULL)
+		goto err;
+	memlock_region(rs->fifo, rs->fifo_cap*sizeof(float));
+	rs->fifo_n = RESAMPLE_SLACK_FRAMES;
+
+	// the filters' delay, both in frames at the stream's rate
+	latency = (taps*rs->down.up-1)/(2.0*rs->down.up) +
+	          (taps*rs->up.up-1)/(2.0*rs->up.up)*fmt->rate/rate;
+	pl->rs_latency = (int)(latency+0.5)+RESAMPLE_SLACK_FRAMES;
+
+	fprintf(stderr, "%s runs at %d Hz instead of %d Hz (%u taps, %d frames latency)\n",
+	    superbasename(pl->opts.path), rate, fmt->rate, taps, pl->rs_latency);
+
+	return true;
+err:
+	perror("resample_setup");
+	resample_free(pl);
+	return false;
+}
+
+void
+resample_free(struct plugin *pl)
+{
+	struct resampler *rs = pl->rs;
+
+	if (rs == NULL)
+		return;
+
+	stage_free(&rs->down);
+	stage_free(&rs->up);
+	memlock_unlock(rs->a, rs->ab_cap*sizeof(float));
+	memlock_unlock(rs->b, rs->ab_cap*sizeof(float));
+	memlock_unlock(rs->fifo, rs->fifo_cap*sizeof(float));
+	free(rs->a);
+	free(rs->b);
+	buf_free(&rs->pcm);
+	free(rs->fifo);
+	free(rs);
+
+	pl->rs = NULL;
+	pl->rs_latency = 0;
+}
+
+void
+resample_reset(struct plugin *pl)
+{
+	struct resampler *rs = pl->rs;
+
+	if (rs == NULL)
+		return;
+
+	stage_reset(&rs->down);
+	stage_reset(&rs->up);
+
+	memset(rs->fifo, 0, RESAMPLE_SLACK_FRAMES*rs->down.ch*sizeof(float));
+	rs->fifo_n = RESAMPLE_SLACK_FRAMES;
+}
+
+int
+resample_modify_samples(struct plugin *pl,
+                        struct fmt *fmt,
+                        char *samples,
+                        int frames,
+                        int stretch_factor)
+{
+	struct resampler *rs = pl->rs;
+	struct fmt pfmt = *fmt;
+	const int ch = fmt->ch;
+	size_t need, mid, back, want, have;
+	uint64_t t0, t1, t2;
+	int plug_rv;
+
+	pfmt.rate = pl->rate;
+
+	t0 = now_ns();
+
+	// past the preallocated size
+	need = MAX((size_t)frames, stage_max_out(&rs->down, frames)*stretch_factor)*ch;
+	if U (need > rs->ab_cap) {
+		memlock_unlock(rs->b, rs->ab_cap*sizeof(float));
+		if (!grow_floats(&rs->a, &rs->ab_cap, need) ||
+		    (rs->b = realloc(rs->b, rs->ab_cap*sizeof(float))) == NULL)
+			assert(!"resample_modify_samples: realloc");
+		memlock_region(rs->b, rs->ab_cap*sizeof(float));
+	}
+
+	conv_to_float(rs->a, samples, fmt->bps, (size_t)frames*ch);
+	mid = stage_process(&rs->down, rs->a, frames, rs->b);
+
+	buf_prepare_capacity(&rs->pcm, fmt_frames2bytes(&pfmt, mid*stretch_factor));
+	conv_from_float(rs->pcm.p, fmt->bps, rs->b, mid*ch);
+
+	t1 = now_ns();
+
+	plug_rv = plugin_modify_samples(pl, &pfmt, rs->pcm.p, mid, stretch_factor);
+	if U (plug_rv < 0)
+		return plug_rv;
+
+	t2 = now_ns();
+
+	conv_to_float(rs->a, rs->pcm.p, fmt->bps, (size_t)plug_rv*ch);
+
+	back = stage_max_out(&rs->up, plug_rv);
+	if U (!grow_floats(&rs->fifo, &rs->fifo_cap, (rs->fifo_n+back)*ch))
+		assert(!"resample_modify_samples: realloc");
+	rs->fifo_n += stage_process(&rs->up, rs->a, plug_rv, rs->fifo+rs->fifo_n*ch);
+
+	//
+	// same number of frames back unless the plugin stretched. then
+	//  whatever there is, as much as fits
+	//
+	if L ((size_t)plug_rv == mid || stretch_factor == 1)
+		want = frames;
+	else
+		want = MIN(rs->fifo_n, (size_t)frames*stretch_factor);
+
+	have = MIN(want, rs->fifo_n);
+	conv_from_float(samples, fmt->bps, rs->fifo, have*ch);
+	if U (have < want)
+		memset(samples+fmt_frames2bytes(fmt, have), 0, fmt_frames2bytes(fmt, want-have));
+
+	memmove(rs->fifo, rs->fifo+have*ch, (rs->fifo_n-have)*ch*sizeof(float));
+	rs->fifo_n -= have;
+
+	pl->stats.resample_ns += (t1-t0)+(now_ns()-t2);
+
+	return want;
+}
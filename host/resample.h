@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "fmt.h"
+#include "plugin.h"
+
+//
+// resample=Q: run a plugin that doesn't support the sample rate at one it
+//  does support, with the data resampled in front of it and back after it
+//  (like the bit depth adapters in chain.c)
+//
+// the filters are polyphase windowed sinc with 8<<(Q-1) taps per phase,
+//  Q = 1 to 4. everything is allocated by resample_setup() for blocks up to
+//  RESAMPLE_PREALLOC_FRAMES and only grows past that if it has to
+//
+// the output is delayed by pl->rs_latency frames (filter delay both ways,
+//  plus a few frames of slack so the output never runs short)
+//
+
+#define RESAMPLE_QUALITY_MAX 4
+#define RESAMPLE_PREALLOC_FRAMES 4096
+
+//
+// set up the resampler for going from fmt->rate to rate and back. replaces
+//  any old one
+//
+bool
+resample_setup(struct plugin *pl, const struct fmt *fmt, int rate);
+
+void
+resample_free(struct plugin *pl);
+
+//
+// forget the audio in the filters, like after resample_setup()
+//
+void
+resample_reset(struct plugin *pl);
+
+//
+// ModifySamples() through the resampler. always gives back `frames`
+//  frames, or up to frames*stretch_factor if the plugin stretches
+//
+int
+resample_modify_samples(struct plugin *pl,
+                        struct fmt *fmt,
+                        char *samples,
+                        int frames,
+                        int stretch_factor);
@@ -0,0 +1,178 @@
+#include "sched.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "misc.h"
+
+// looked up at runtime, they're not in every version of windows (or wine)
+typedef HANDLE (WINAPI *AvSetMmThreadCharacteristicsA_t)(LPCSTR, LPDWORD);
+typedef BOOL (WINAPI *AvRevertMmThreadCharacteristics_t)(HANDLE);
+typedef HRESULT (WINAPI *SetThreadDescription_t)(HANDLE, const WCHAR *);
+
+static HMODULE avrt = NULL;
+
+// (split= instances have threads of their own that are set up the same way)
+static _Thread_local HANDLE mmcss = NULL;
+
+// -----------------------------------------------------------------------------
+
+//
+// "0,2-3" -> 0b1101. false if it's malformed or empty
+//
+static bool
+parse_cpus(const char *s, DWORD_PTR *out)
+{
+	DWORD_PTR mask = 0;
+	const int maxcpu = (int)(sizeof(DWORD_PTR)*8)-1;
+
+	while (*s != '\0') {
+		char *end;
+		long lo, hi;
+
+		lo = hi = strtol(s, &end, 10);
+		if (end == s)
+			return false;
+		s = end;
+
+		if (*s == '-') {
+			s++;
+			hi = strtol(s, &end, 10);
+			if (end == s)
+				return false;
+			s = end;
+		}
+		if (lo < 0 || hi > maxcpu || lo > hi)
+			return false;
+
+		for (long i = lo; i <= hi; i++)
+			mask |= (DWORD_PTR)1<<i;
+
+		if (*s == ',')
+			s++;
+		else if (*s != '\0')
+			return false;
+	}
+
+	*out = mask;
+
+	return mask != 0;
+}
+
+static bool
+getenv_cpus(const char *name, DWORD_PTR *out)
+{
+	const char *s = getenv(name);
+
+	if (s == NULL || *s == '\0')
+		return false;
+
+	if (!parse_cpus(s, out)) {
+		fprintf(stderr, "warning: couldn't parse %s=%s\n", name, s);
+		return false;
+	}
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+sched_setup_process(void)
+{
+	DWORD_PTR mask;
+
+	if (getenv_cpus("DDW_AFFINITY", &mask) &&
+	    !SetProcessAffinityMask(GetCurrentProcess(), mask))
+		PrintError("SetProcessAffinityMask");
+}
+
+static bool
+set_mmcss(const char *task)
+{
+	AvSetMmThreadCharacteristicsA_t set;
+	DWORD idx = 0;
+
+	if (avrt == NULL)
+		avrt = LoadLibrary("avrt.dll");
+	if (avrt == NULL) {
+		PrintError("LoadLibrary(avrt.dll)");
+		return false;
+	}
+
+	set = (AvSetMmThreadCharacteristicsA_t)(void *)GetProcAddress(avrt, "AvSetMmThreadCharacteristicsA");
+	if (set == NULL) {
+		PrintError("GetProcAddress(AvSetMmThreadCharacteristicsA)");
+		return false;
+	}
+
+	mmcss = set(task, &idx);
+	if (mmcss == NULL) {
+		PrintError("AvSetMmThreadCharacteristicsA");
+		return false;
+	}
+
+	return true;
+}
+
+void
+sched_setup_thread(void)
+{
+	SetThreadDescription_t setdesc;
+	const char *prio;
+	DWORD_PTR mask;
+	int tp;
+
+	setdesc = (SetThreadDescription_t)(void *)GetProcAddress(GetModuleHandle("kernel32.dll"), "SetThreadDescription");
+	if (setdesc != NULL)
+		setdesc(GetCurrentThread(), L"ddw_process");
+
+	if (getenv_cpus("DDW_THREAD_AFFINITY", &mask) &&
+	    SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+		PrintError("SetThreadAffinityMask");
+
+	prio = getenv("DDW_PRIORITY");
+	if (prio == NULL || *prio == '\0' || strcmp(prio, "normal") == 0)
+		return;
+
+	if (strcmp(prio, "mmcss") == 0 || strncmp(prio, "mmcss:", 6) == 0) {
+		const char *task = (prio[5] == ':') ? prio+6 : "Pro Audio";
+
+		if (set_mmcss(task))
+			return;
+
+		// fall back to just a high priority
+		prio = "critical";
+	}
+
+	if (strcmp(prio, "high") == 0) {
+		tp = THREAD_PRIORITY_HIGHEST;
+	} else if (strcmp(prio, "critical") == 0) {
+		tp = THREAD_PRIORITY_TIME_CRITICAL;
+	} else {
+		fprintf(stderr, "warning: unknown DDW_PRIORITY=%s\n", prio);
+		return;
+	}
+
+	if (!SetThreadPriority(GetCurrentThread(), tp))
+		PrintError("SetThreadPriority");
+}
+
+void
+sched_teardown_thread(void)
+{
+	AvRevertMmThreadCharacteristics_t revert;
+
+	if (mmcss == NULL)
+		return;
+
+	revert = (AvRevertMmThreadCharacteristics_t)(void *)GetProcAddress(avrt, "AvRevertMmThreadCharacteristics");
+	if (revert != NULL)
+		revert(mmcss);
+	mmcss = NULL;
+}
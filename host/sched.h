@@ -0,0 +1,36 @@
+#pragma once
+
+//
+// scheduling for the pipe mode, set up from the environment:
+//
+//   DDW_PRIORITY=P         priority of the processing thread: one of
+//                          "normal" (default), "high", "critical", or
+//                          "mmcss" / "mmcss:task" to register it with MMCSS
+//                          as "Pro Audio" (or the named task)
+//   DDW_AFFINITY=cpus      cpus for the whole host, e.g. "2,3" or "2-3"
+//   DDW_THREAD_AFFINITY=cpus  cpus for just the processing thread
+//
+// the plugin sets these from its ddw.host_* config. wine passes the
+//  priorities on to linux only if it's set up to (e.g. wine-staging with
+//  WINE_RT_PRIORITY_BASE), the plugin's ddw.host_rtprio works without that
+//
+
+//
+// call from the main thread before starting the processing thread
+//
+void
+sched_setup_process(void);
+
+//
+// call from the processing thread, and from any other thread it waits for
+//  (split=). they get the name "ddw_process", which is what the plugin looks
+//  for to make them SCHED_FIFO
+//
+void
+sched_setup_thread(void);
+
+//
+// undo what sched_setup_thread() did that needs undoing
+//
+void
+sched_teardown_thread(void);
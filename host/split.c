@@ -0,0 +1,431 @@
+#include "split.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buf.h"
+#include "log.h"
+#include "macros.h"
+#include "memlock.h"
+#include "misc.h"
+#include "sched.h"
+
+#define SPLIT_MAX_PARTS SPLIT_MAX_CH
+
+struct split_part {
+	winampDSPModule *module;
+	HMODULE dll;
+	char *copy; // path of the dll copy, NULL for the first instance
+
+	HANDLE thread;
+	HANDLE go;
+	HANDLE done;
+	volatile bool quit;
+
+	// the current ModifySamples() call
+	struct buf buf;
+	const struct fmt *fmt;
+	int ch;
+	int frames;
+	int rv;
+};
+
+struct plugin_split {
+	unsigned int cnt;
+	struct split_part parts[SPLIT_MAX_PARTS];
+};
+
+// -----------------------------------------------------------------------------
+
+static void
+part_run(struct split_part *part)
+{
+	part->rv = part->module->ModifySamples(part->module,
+	    (short int *)part->buf.p,
+	    part->frames,
+	    part->fmt->bps,
+	    part->ch,
+	    part->fmt->rate);
+}
+
+static DWORD WINAPI
+part_thread_main(void *ud)
+{
+	struct split_part *part = ud;
+	bool sched_done = false;
+
+	// the dll's ModifySamples() runs on this stack too. part->buf is locked
+	//  by buf_prepare_capacity()
+	memlock_setup_thread();
+
+	for (;;) {
+		WaitForSingleObject(part->go, INFINITE);
+		if (part->quit)
+			break;
+
+		// the processing thread waits for this one, so it gets the same
+		//  priority. not before the first block, the process isn't set up
+		//  for processing until after the dlls are loaded
+		if U (!sched_done) {
+			sched_setup_thread();
+			sched_done = true;
+		}
+
+		part_run(part);
+		SetEvent(part->done);
+	}
+
+	if (sched_done)
+		sched_teardown_thread();
+
+	return 0;
+}
+
+//
+// copy the dll to dir (which ends with a slash, or is empty for the current
+//  directory) under a name of its own
+//
+static char *
+copy_dll(const char *path, const char *dir, int dirlen, unsigned int idx)
+{
+	static unsigned int counter = 0;
+	const char *base = superbasename(path);
+	size_t sz = dirlen+64+strlen(base);
+	char *copy;
+
+	copy = malloc(sz);
+	if (copy == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+	snprintf(copy, sz, "%.*sddw_split.%lu.%u.%u.%s",
+	    dirlen, dir, (unsigned long)GetCurrentProcessId(), counter++, idx,
+	    base);
+
+	if (!CopyFile(path, copy, FALSE)) {
+		PrintError("CopyFile");
+		free(copy);
+		return NULL;
+	}
+
+	return copy;
+}
+
+//
+// is there a process with this id? (one we can't open exists too)
+//
+static bool
+pid_alive(DWORD pid)
+{
+	HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	bool alive;
+
+	if (h == NULL)
+		return GetLastError() == ERROR_ACCESS_DENIED;
+
+	alive = (WaitForSingleObject(h, 0) == WAIT_TIMEOUT);
+	CloseHandle(h);
+
+	return alive;
+}
+
+//
+// delete the copies in dir that hosts which didn't get to part_free() left
+//  behind (stopped with SIGKILL, or aborted). they have the host's process
+//  id in the name, the ones of hosts that are still running are left alone
+//
+static void
+sweep_copies(const char *dir, int dirlen)
+{
+	char pattern[MAX_PATH];
+	char path[MAX_PATH];
+	WIN32_FIND_DATA fd;
+	HANDLE find;
+
+	if (snprintf(pattern, sizeof(pattern), "%.*sddw_split.*", dirlen, dir) >= (int)sizeof(pattern))
+		return;
+
+	find = FindFirstFile(pattern, &fd);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+
+	do {
+		unsigned long pid;
+
+		if (sscanf(fd.cFileName, "ddw_split.%lu.", &pid) != 1 ||
+		    pid == (unsigned long)GetCurrentProcessId() ||
+		    pid_alive(pid))
+			continue;
+
+		if (snprintf(path, sizeof(path), "%.*s%s", dirlen, dir, fd.cFileName) >= (int)sizeof(path))
+			continue;
+		if (DeleteFile(path))
+			fprintf(stderr, "deleted %s, left behind by an earlier host\n", path);
+	} while (FindNextFile(find, &fd));
+
+	FindClose(find);
+}
+
+static bool
+part_load(struct plugin *pl, struct split_part *part, unsigned int idx)
+{
+	char dir[MAX_PATH];
+	int module_idx = pl->opts.module_idx;
+
+	// next to the original so it finds the same files through its own path
+	part->copy = copy_dll(pl->opts.path, pl->opts.path,
+	    superbasename(pl->opts.path)-pl->opts.path, idx);
+
+	if (part->copy == NULL) {
+		if (GetTempPath(sizeof(dir), dir) == 0) {
+			PrintError("GetTempPath");
+			return false;
+		}
+		part->copy = copy_dll(pl->opts.path, dir, strlen(dir), idx);
+		if (part->copy == NULL)
+			return false;
+
+		fprintf(stderr, "warning: couldn't copy %s to its own directory, instance %u is loaded from %s and won't find files it looks for next to itself\n",
+		    superbasename(pl->opts.path), idx, part->copy);
+	}
+
+	part->module = load_module(part->copy, &module_idx, &part->dll, NULL);
+	if (part->module == NULL)
+		return false;
+
+	part->go = CreateEvent(NULL, FALSE, FALSE, NULL);
+	part->done = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (part->go == NULL || part->done == NULL) {
+		PrintError("CreateEvent");
+		return false;
+	}
+
+	part->thread = CreateThread(NULL,
+	                            1024*1024,
+	                            part_thread_main,
+	                            part,
+	                            STACK_SIZE_PARAM_IS_A_RESERVATION,
+	                            NULL);
+	if (part->thread == NULL) {
+		PrintError("CreateThread");
+		return false;
+	}
+
+	return true;
+}
+
+static void
+part_free(struct split_part *part)
+{
+	if (part->thread != NULL) {
+		part->quit = true;
+		SetEvent(part->go);
+		WaitForSingleObject(part->thread, INFINITE);
+		CloseHandle(part->thread);
+	}
+	if (part->go != NULL)
+		CloseHandle(part->go);
+	if (part->done != NULL)
+		CloseHandle(part->done);
+
+	if (part->module != NULL) {
+		part->module->Quit(part->module);
+		FreeLibrary(part->dll);
+	}
+
+	// (can't delete it while it's loaded)
+	if (part->copy != NULL) {
+		if (!DeleteFile(part->copy))
+			fprintf(stderr, "warning: couldn't delete %s: %s\n",
+			    part->copy, StrError(GetLastError()));
+		free(part->copy);
+	}
+
+	buf_free(&part->buf);
+}
+
+// -----------------------------------------------------------------------------
+
+bool
+split_load(struct plugin *pl)
+{
+	struct plugin_split *sp;
+	unsigned int cnt = (SPLIT_MAX_CH+pl->opts.split-1)/pl->opts.split;
+	char dir[MAX_PATH];
+
+	if (cnt < 2) {
+		fprintf(stderr, "warning: split=%d for %s does nothing with %d channels max\n",
+		    pl->opts.split, superbasename(pl->opts.path), SPLIT_MAX_CH);
+		return true;
+	}
+
+	// wherever part_load() may have put them
+	sweep_copies(pl->opts.path, superbasename(pl->opts.path)-pl->opts.path);
+	if (GetTempPath(sizeof(dir), dir) != 0)
+		sweep_copies(dir, strlen(dir));
+
+	sp = calloc(1, sizeof(*sp));
+	if (sp == NULL) {
+		perror("calloc");
+		return false;
+	}
+	pl->split = sp;
+
+	sp->parts[0].module = pl->module;
+	sp->parts[0].dll = pl->dll;
+	sp->cnt = 1;
+
+	for (unsigned int i = 1; i < cnt; i++) {
+		if (!part_load(pl, &sp->parts[i], i)) {
+			fprintf(stderr, "error: failed to load instance %u of %s for split=%d\n",
+			    i, superbasename(pl->opts.path), pl->opts.split);
+			// (the half-loaded one too)
+			sp->cnt = i+1;
+			split_free(pl);
+			return false;
+		}
+		sp->cnt = i+1;
+	}
+
+	printf("%s: split into %u instances of %d channels\n",
+	    superbasename(pl->opts.path), sp->cnt, pl->opts.split);
+
+	return true;
+}
+
+void
+split_free(struct plugin *pl)
+{
+	struct plugin_split *sp = pl->split;
+
+	if (sp == NULL)
+		return;
+
+	// the first one is pl->module, unloaded by the caller
+	for (unsigned int i = 1; i < sp->cnt; i++)
+		part_free(&sp->parts[i]);
+	buf_free(&sp->parts[0].buf);
+
+	free(sp);
+	pl->split = NULL;
+}
+
+bool
+split_restart(struct plugin *pl)
+{
+	struct plugin_split *sp = pl->split;
+
+	if (sp == NULL)
+		return true;
+
+	for (unsigned int i = 1; i < sp->cnt; i++) {
+		struct split_part *part = &sp->parts[i];
+		int init_rv;
+
+		part->module->Quit(part->module);
+
+		init_rv = part->module->Init(part->module);
+		if (init_rv != 0) {
+			fprintf(stderr, "plugin_restart: Init() failed for instance %u of %s! (%d)\n",
+			    i, superbasename(pl->opts.path), init_rv);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+unsigned int
+split_groups(struct plugin *pl, const struct fmt *fmt)
+{
+	if (pl->opts.split == 0 || fmt->ch <= pl->opts.split)
+		return 0;
+
+	return (fmt->ch+pl->opts.split-1)/pl->opts.split;
+}
+
+unsigned int
+split_instances(struct plugin *pl)
+{
+	return (pl->split != NULL) ? pl->split->cnt : 1;
+}
+
+// -----------------------------------------------------------------------------
+
+static void
+deinterleave(char *dst, const char *src, int frames, size_t dst_fs, size_t src_fs)
+{
+	for (int i = 0; i < frames; i++) {
+		memcpy(dst, src, dst_fs);
+		dst += dst_fs;
+		src += src_fs;
+	}
+}
+
+static void
+interleave(char *dst, const char *src, int frames, size_t dst_fs, size_t src_fs)
+{
+	for (int i = 0; i < frames; i++) {
+		memcpy(dst, src, src_fs);
+		dst += dst_fs;
+		src += src_fs;
+	}
+}
+
+int
+split_modify_samples(struct plugin *pl,
+                     struct fmt *fmt,
+                     char *samples,
+                     int frames,
+                     int stretch_factor)
+{
+	struct plugin_split *sp = pl->split;
+	const unsigned int groups = split_groups(pl, fmt);
+	const size_t ss = fmt->bps/8;
+	const size_t fs = fmt_frame_size(fmt);
+	int rv_min = INT_MAX, rv_max = INT_MIN;
+
+D	assert(groups >= 2 && groups <= sp->cnt);
+
+	for (unsigned int i = 0; i < groups; i++) {
+		struct split_part *part = &sp->parts[i];
+
+		part->fmt = fmt;
+		part->ch = MIN(pl->opts.split, fmt->ch-(int)i*pl->opts.split);
+		part->frames = frames;
+
+		buf_prepare_capacity(&part->buf, (size_t)frames*stretch_factor*part->ch*ss);
+		deinterleave(part->buf.p, samples+i*pl->opts.split*ss, frames, part->ch*ss, fs);
+	}
+
+	for (unsigned int i = 1; i < groups; i++)
+		SetEvent(sp->parts[i].go);
+
+	part_run(&sp->parts[0]);
+
+	for (unsigned int i = 1; i < groups; i++)
+		WaitForSingleObject(sp->parts[i].done, INFINITE);
+
+	for (unsigned int i = 0; i < groups; i++) {
+		rv_min = MIN(rv_min, sp->parts[i].rv);
+		rv_max = MAX(rv_max, sp->parts[i].rv);
+	}
+
+	// the instances don't agree on how much they stretched. keep what all
+	//  of them have
+	if U (rv_min != rv_max)
+		log_post(LOG_SPLIT_MISMATCH, pl->opts.path, rv_min, rv_max, 0, 0);
+
+	if (rv_min <= 0)
+		return rv_min;
+
+	for (unsigned int i = 0; i < groups; i++) {
+		struct split_part *part = &sp->parts[i];
+
+		interleave(samples+i*pl->opts.split*ss, part->buf.p, rv_min, fs, part->ch*ss);
+	}
+
+	return rv_min;
+}
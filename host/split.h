@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "fmt.h"
+#include "plugin.h"
+
+//
+// split=N: run the dll as several instances that get N channels each, so
+//  stereo-only dsps work on 5.1 and 7.1, and a dll that takes all the
+//  channels can use more than one core
+//
+// every instance but the first is a copy of the dll, since loading the same
+//  file again would just give back the same module and its state. the copies
+//  go in the dll's own directory so ones that look for their presets, ini
+//  or other dlls next to themselves still find them. if that directory
+//  can't be written to they go in the temp directory instead, with a
+//  warning. each copy has a thread that calls its ModifySamples() while the
+//  processing thread does the first one
+//
+// the copies are deleted when the host exits, or by the next one to load a
+//  split= dll if it didn't get to (killed, aborted)
+//
+// enough instances for SPLIT_MAX_CH channels are loaded up front
+//
+
+#define SPLIT_MAX_CH 8
+
+//
+// load the other instances. pl must be loaded already
+//
+bool
+split_load(struct plugin *pl);
+
+//
+// stop the threads and unload everything but the first instance
+//
+void
+split_free(struct plugin *pl);
+
+//
+// Quit() and Init() the other instances (see plugin_restart())
+//
+bool
+split_restart(struct plugin *pl);
+
+//
+// how many instances the format needs, 0 if it isn't split at all
+//
+unsigned int
+split_groups(struct plugin *pl, const struct fmt *fmt);
+
+unsigned int
+split_instances(struct plugin *pl);
+
+//
+// ModifySamples() for a split plugin. the buffer must have room for
+//  frames*stretch_factor frames
+//
+int
+split_modify_samples(struct plugin *pl,
+                     struct fmt *fmt,
+                     char *samples,
+                     int frames,
+                     int stretch_factor);
@@ -1,5 +1,6 @@
 #include "wndproc.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #include <Winamp/wa_ipc.h>
@@ -53,6 +54,120 @@ get_lastplug(void)
 }
 #define LASTPLUG get_lastplug()
 
+// -----------------------------------------------------------------------------
+
+//
+// plugins may poll an unsupported message on every block, so printing a
+//  warning each time would mean thousands of stderr writes per second from
+//  the processing path
+// instead, each distinct (message, id, plugin) is counted in a fixed table.
+//  the first occurrence gets printed as before and the rest are summarized
+//  every UNSUP_SUMMARY_MS from a timer
+//
+// "id" is what identifies the request for that message: lParam for
+//  WM_WA_IPC, dwData for WM_COPYDATA and the command id for WM_COMMAND
+//
+// only the main thread calls WindowProc() so no locking is needed
+//
+
+#define UNSUP_TABLE_SIZE 64
+#define UNSUP_SUMMARY_MS 10000
+#define IDT_UNSUP_SUMMARY 1
+
+static struct unsup {
+	UINT msg; // 0 = free slot
+	LPARAM id;
+	int plugidx;
+	unsigned int count;
+	unsigned int reported; // count at the time of the last summary
+} unsup_table[UNSUP_TABLE_SIZE];
+
+static unsigned int unsup_overflow; // messages that didn't fit in the table
+static unsigned int unsup_overflow_reported;
+
+static bool unsup_timer_set;
+
+static const char *
+msgname(UINT msg)
+{
+	switch (msg) {
+	case WM_COPYDATA: return "WM_COPYDATA";
+	case WM_WA_IPC: return "WM_WA_IPC";
+	case WM_WA_SYSTRAY: return "WM_WA_SYSTRAY";
+	case WM_WA_MPEG_EOF: return "WM_WA_MPEG_EOF";
+	case WM_COMMAND: return "WM_COMMAND";
+	default: return "?";
+	}
+}
+
+//
+// count an unsupported message
+// returns true if it's the first of its kind and should be printed
+//
+static bool
+unsupported_first(HWND hwnd, UINT msg, LPARAM id)
+{
+	int plugidx = procidx;
+	unsigned int h = ((unsigned int)msg*31u + (unsigned int)id*7u + (unsigned int)plugidx) % UNSUP_TABLE_SIZE;
+
+	for (unsigned int i = 0; i < UNSUP_TABLE_SIZE; i++) {
+		struct unsup *e = &unsup_table[(h+i) % UNSUP_TABLE_SIZE];
+
+		if (e->msg == msg && e->id == id && e->plugidx == plugidx) {
+			e->count++;
+			return false;
+		}
+
+		if (e->msg == 0) {
+			*e = (struct unsup){
+				.msg = msg,
+				.id = id,
+				.plugidx = plugidx,
+				.count = 1,
+				.reported = 1,
+			};
+			if (!unsup_timer_set) {
+				fprintf(stderr, "note: repeated unsupported messages are counted and summarized every %d seconds\n",
+				    UNSUP_SUMMARY_MS/1000);
+				unsup_timer_set = (SetTimer(hwnd, IDT_UNSUP_SUMMARY, UNSUP_SUMMARY_MS, NULL) != 0);
+			}
+			return true;
+		}
+	}
+
+	unsup_overflow++;
+	return false;
+}
+
+void
+wndproc_print_summary(void)
+{
+	for (unsigned int i = 0; i < UNSUP_TABLE_SIZE; i++) {
+		struct unsup *e = &unsup_table[i];
+
+		if (e->msg == 0 || e->count == e->reported)
+			continue;
+
+		fprintf(stderr, "warning: unsupported %s %ld (%s) repeated %u times (%u total)\n",
+		    msgname(e->msg),
+		    e->id,
+		    (e->plugidx >= 0 && (unsigned)e->plugidx < plugins_cnt) ?
+		        superbasename(plugins[e->plugidx].opts.path) : "?",
+		    e->count-e->reported,
+		    e->count);
+
+		e->reported = e->count;
+	}
+
+	if (unsup_overflow != unsup_overflow_reported) {
+		fprintf(stderr, "warning: %u more unsupported messages didn't fit in the table\n",
+		    unsup_overflow-unsup_overflow_reported);
+		unsup_overflow_reported = unsup_overflow;
+	}
+}
+
+// -----------------------------------------------------------------------------
+
 LRESULT CALLBACK
 WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
@@ -65,30 +180,74 @@ WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	// - https://wiki.hydrogenaud.io/index.php?title=Foobar2000:Title_Formatting_Reference
 	//
 	switch (uMsg) {
+	case WM_TIMER: // 0x0113
+		if (wParam == IDT_UNSUP_SUMMARY) {
+			wndproc_print_summary();
+			return 0;
+		}
+		break;
 	case WM_COPYDATA: // 0x004A
-		fprintf(stderr, "warning: unsupported WM_COPYDATA: wParam=%d lParam=%ld (%s)\n",
-		    wParam, lParam, LASTPLUG);
+		if (unsupported_first(hwnd, uMsg, lParam ? (LPARAM)((COPYDATASTRUCT *)lParam)->dwData : 0))
+			fprintf(stderr, "warning: unsupported WM_COPYDATA: wParam=%d lParam=%ld (%s)\n",
+			    wParam, lParam, LASTPLUG);
 		break;
 	case WM_WA_IPC: // WM_USER (0x0400)
 		switch (lParam) {
+		case IPC_ISPLAYING: // 104
+			switch (shm->isplaying) {
+			case ISPLAYING_PLAYING: return 1;
+			case ISPLAYING_PAUSED: return 3;
+			default: return 0;
+			}
 		case IPC_GETOUTPUTTIME: // 105
 			switch (wParam) {
 			case 0: // position in ms of the currently playing track
 //				fprintf(stderr, "GET shm->playback_pos_ms = %d (%s)\n", shm->playback_pos_ms, LASTPLUG);
 				return shm->playback_pos_ms;
 			case 1: // current track length in seconds
-				fprintf(stderr, "GET shm->track_duration_ms = %d (%s)\n", shm->track_duration_ms, LASTPLUG);
+//				fprintf(stderr, "GET shm->track_duration_ms = %d (%s)\n", shm->track_duration_ms, LASTPLUG);
 				return shm->track_duration_ms/1000;
 			case 2: // current track length in milliseconds
-				fprintf(stderr, "GET shm->track_duration_ms = %d (%s)\n", shm->track_duration_ms, LASTPLUG);
+//				fprintf(stderr, "GET shm->track_duration_ms = %d (%s)\n", shm->track_duration_ms, LASTPLUG);
 				return shm->track_duration_ms;
 			}
-			fprintf(stderr, "warning: unsupported IPC_GETOUTPUTTIME: wParam=%d lParam=%ld (%s)\n",
-			    wParam, lParam, LASTPLUG);
+			if (unsupported_first(hwnd, uMsg, lParam))
+				fprintf(stderr, "warning: unsupported IPC_GETOUTPUTTIME: wParam=%d lParam=%ld (%s)\n",
+				    wParam, lParam, LASTPLUG);
 			return -1;
+		case IPC_SETVOLUME: // 122
+			if ((int)wParam == -666) // -666 = get the current volume
+				return shm->volume;
+			if (unsupported_first(hwnd, uMsg, lParam))
+				fprintf(stderr, "warning: unsupported IPC_SETVOLUME: wParam=%d lParam=%ld (%s)\n",
+				    wParam, lParam, LASTPLUG);
+			return 0;
 		case IPC_GETLISTPOS: // 125
 //			fprintf(stderr, "GET shm->track_idx = %d (%s)\n", shm->track_idx, LASTPLUG);
 			return shm->track_idx;
+		case IPC_GETINFO: // 126
+			switch (wParam) {
+			case 0: // sample rate in kHz
+				return shm->samplerate/1000;
+			case 1: // bitrate in kbps
+				return shm->bitrate;
+			case 2: // channels
+				return shm->channels;
+			case 5: // sample rate in Hz
+				return shm->samplerate;
+			}
+			if (unsupported_first(hwnd, uMsg, lParam))
+				fprintf(stderr, "warning: unsupported IPC_GETINFO: wParam=%d lParam=%ld (%s)\n",
+				    wParam, lParam, LASTPLUG);
+			return 0;
+		case IPC_GETPLAYLISTFILE: // 211
+			// only the playing track is known
+			if ((int)wParam == shm->track_idx)
+				return (uintptr_t)shm->track_filename;
+			if (unsupported_first(hwnd, uMsg, lParam))
+				fprintf(stderr, "warning: unsupported IPC_GETPLAYLISTFILE: wParam=%d lParam=%ld (%s)\n",
+				    wParam, lParam, LASTPLUG);
+			return 0;
 		case IPC_GETPLAYLISTTITLE: // 212
 //			fprintf(stderr, "GET shm->track_title = \"%s\" (%s)\n", shm->track_title, LASTPLUG);
 			return (uintptr_t)shm->track_title;
@@ -96,25 +255,30 @@ WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			// supposed to return a pointer to some C++ abomination added in winamp 5.12
 			return 1; // 1 = not supported
 		case IPC_REGISTER_WINAMP_IPCMESSAGE: // 65536
-			fprintf(stderr, "warning: unsupported WM_WA_IPC: wParam=\"%s\" lParam=%ld (%s)\n",
-			    (const char *)wParam, lParam, LASTPLUG);
+			if (unsupported_first(hwnd, uMsg, lParam))
+				fprintf(stderr, "warning: unsupported WM_WA_IPC: wParam=\"%s\" lParam=%ld (%s)\n",
+				    (const char *)wParam, lParam, LASTPLUG);
 			break;
 		default:
-			fprintf(stderr, "warning: unsupported WM_WA_IPC: wParam=%d lParam=%ld (%s)\n",
-			    wParam, lParam, LASTPLUG);
+			if (unsupported_first(hwnd, uMsg, lParam))
+				fprintf(stderr, "warning: unsupported WM_WA_IPC: wParam=%d lParam=%ld (%s)\n",
+				    wParam, lParam, LASTPLUG);
 		}
 		break;
 	case WM_WA_SYSTRAY: // WM_USER+1
-		fprintf(stderr, "warning: unsupported WM_WA_SYSTRAY: wParam=%d lParam=%ld (%s)\n",
-		    wParam, lParam, LASTPLUG);
+		if (unsupported_first(hwnd, uMsg, wParam))
+			fprintf(stderr, "warning: unsupported WM_WA_SYSTRAY: wParam=%d lParam=%ld (%s)\n",
+			    wParam, lParam, LASTPLUG);
 		break;
 	case WM_WA_MPEG_EOF: // WM_USER+2
-		fprintf(stderr, "warning: unsupported WM_WA_MPEG_EOF: wParam=%d lParam=%ld (%s)\n",
-		    wParam, lParam, LASTPLUG);
+		if (unsupported_first(hwnd, uMsg, wParam))
+			fprintf(stderr, "warning: unsupported WM_WA_MPEG_EOF: wParam=%d lParam=%ld (%s)\n",
+			    wParam, lParam, LASTPLUG);
 		break;
 	case WM_COMMAND: // 0x0111
-		fprintf(stderr, "warning: unsupported WM_COMMAND: wParam=%d lParam=%ld (%s)\n",
-		    wParam, lParam, LASTPLUG);
+		if (unsupported_first(hwnd, uMsg, LOWORD(wParam)))
+			fprintf(stderr, "warning: unsupported WM_COMMAND: wParam=%d lParam=%ld (%s)\n",
+			    wParam, lParam, LASTPLUG);
 		break;
 	}
 
@@ -5,3 +5,6 @@
 
 LRESULT CALLBACK
 WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+void
+wndproc_print_summary(void);
@@ -0,0 +1,411 @@
+#include "child.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ddw.h"
+#include "fmt.h"
+#include "plugin.h"
+
+//
+// render cache: if ddw.cache_dir is set, the output for a whole track is
+//  saved the first time it's played, and played back from there the next
+//  time without the host
+//
+// one file per track and chain, named after a hash of the track
+//  (uri, size, track number, duration) and the chain (dll argument, max. bit
+//  depth, host command). the winamp dlls' own settings aren't in it, clear
+//  the directory after changing them
+//
+// layout: one cache_header, then for every process() call a cache_rec
+//  followed by out_size bytes of output in the format the next dsp wanted
+//
+// each record has a hash of its input, so the cache is only used while the
+//  input is the same as when it was saved. after a miss, a seek or the end
+//  of the file the rest of the track is processed live
+//
+// a track is only saved if it was played from start to end in one go without
+//  errors, and the host didn't say any of its dlls were non-deterministic
+//  (nocache or randomize=)
+//
+// the host is reset at every track that can be cached, so its output doesn't
+//  depend on what was played before. that cuts off the last track's tail
+//  (as much as the chain's latency) at the change
+//
+
+#define CACHE_MAGIC "ddwrnd01"
+
+// how much short of the track's duration still counts as all of it
+#define CACHE_SLACK_MS 100
+
+struct __attribute__((packed)) cache_header {
+	char magic[8];
+	uint64_t key;
+};
+
+struct __attribute__((packed)) cache_rec {
+	uint64_t hash; // of the input and both formats
+	uint32_t frames_in;
+	uint32_t out_size;
+};
+
+// -----------------------------------------------------------------------------
+
+//
+// not cryptographic, just good at noticing that the audio is different
+//
+static uint64_t
+hash64(uint64_t h, const void *p_, size_t sz)
+{
+	const unsigned char *p = p_;
+	size_t i = 0;
+
+	for (; i+8 <= sz; i += 8) {
+		uint64_t w;
+
+		memcpy(&w, p+i, sizeof(w));
+		h = (h^w)*0x100000001b3ull;
+		h ^= h>>29;
+	}
+	for (; i < sz; i++)
+		h = (h^p[i])*0x100000001b3ull;
+
+	return h;
+}
+
+static uint64_t
+hash_str(uint64_t h, const char *s)
+{
+	// (the terminator too, so "ab"+"c" isn't "a"+"bc")
+	return hash64(h, s ?: "", strlen(s ?: "")+1);
+}
+
+static uint64_t
+block_hash(const ddb_waveformat_t *fmt,
+           const ddb_waveformat_t *nextfmt,
+           const char *data,
+           int frames)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+
+	h = hash64(h, fmt, sizeof(ddb_waveformat_t));
+	h = hash64(h, nextfmt, sizeof(ddb_waveformat_t));
+	h = hash64(h, data, fmt_frames2bytes(fmt, frames));
+
+	return h;
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// stop playing from the cache file
+//
+static void
+cache_unmap(struct child *self)
+{
+	if (self->cache_map == NULL)
+		return;
+
+	munmap(self->cache_map, self->cache_mapsz);
+	self->cache_map = NULL;
+	self->cache_mapsz = 0;
+	self->cache_pos = 0;
+}
+
+//
+// stop writing the cache file. it's kept if it has the whole track
+//
+static void
+cache_finish(struct child *self)
+{
+	bool complete;
+
+	if (self->cache_out == NULL)
+		return;
+
+	complete = (self->cache_frames_in+self->cache_slack >= self->cache_frames_want);
+
+	if (fclose(self->cache_out) != 0) {
+		perror("dsp_winamp: cache: fclose");
+		complete = false;
+	}
+	self->cache_out = NULL;
+
+	if (complete && rename(self->cache_tmppath, self->cache_path) == -1) {
+		perror("dsp_winamp: cache: rename");
+		complete = false;
+	}
+	if (!complete)
+		unlink(self->cache_tmppath);
+	else
+		fprintf(stderr, "dsp_winamp: cached %s\n", self->cache_path);
+
+	free(self->cache_tmppath);
+	self->cache_tmppath = NULL;
+}
+
+static void
+cache_abandon(struct child *self, const char *why)
+{
+	if (self->cache_out == NULL)
+		return;
+
+	if (why != NULL)
+		fprintf(stderr, "dsp_winamp: not caching this track: %s\n", why);
+
+	self->cache_frames_in = 0;
+	self->cache_frames_want = UINT64_MAX/2;
+	cache_finish(self);
+}
+
+static bool
+cache_open_map(struct child *self, uint64_t key)
+{
+	struct cache_header hdr;
+	struct stat st;
+	void *p;
+	int fildes;
+
+	fildes = open(self->cache_path, O_RDONLY|O_CLOEXEC);
+	if (fildes == -1)
+		return false;
+
+	if (fstat(fildes, &st) == -1 || (size_t)st.st_size < sizeof(hdr)) {
+		close(fildes);
+		return false;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fildes, 0);
+	close(fildes);
+	if (p == MAP_FAILED) {
+		perror("dsp_winamp: cache: mmap");
+		return false;
+	}
+
+	memcpy(&hdr, p, sizeof(hdr));
+	if (memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic)) != 0 || hdr.key != key) {
+		munmap(p, st.st_size);
+		return false;
+	}
+
+	// (read front to back, once)
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+	self->cache_map = p;
+	self->cache_mapsz = st.st_size;
+	self->cache_pos = sizeof(hdr);
+
+	return true;
+}
+
+static void
+cache_open_out(struct child *self, uint64_t key)
+{
+	static unsigned int counter = 0;
+	struct cache_header hdr = {0};
+
+	if (asprintf(&self->cache_tmppath, "%s.%d.%u.tmp", self->cache_path, getpid(),
+	    __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED)) == -1) {
+		self->cache_tmppath = NULL;
+		return;
+	}
+
+	self->cache_out = fopen(self->cache_tmppath, "we");
+	if (self->cache_out == NULL) {
+		perror("dsp_winamp: cache: fopen");
+		free(self->cache_tmppath);
+		self->cache_tmppath = NULL;
+		return;
+	}
+
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.key = key;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, self->cache_out) != 1)
+		cache_abandon(self, "write failed");
+}
+
+//
+// a new track started streaming. finish with the old one and look for the
+//  new one's cache file, or start writing it
+//
+static void
+cache_begin(struct child *self, DB_playItem_t *it, const ddb_waveformat_t *fmt)
+{
+	uint64_t key = 0xcbf29ce484222325ull;
+	char *dir;
+	float duration;
+
+	cache_finish(self);
+	cache_unmap(self);
+
+	free(self->cache_path);
+	self->cache_path = NULL;
+
+	deadbeef->conf_lock();
+	dir = strdup(deadbeef->conf_get_str_fast("ddw.cache_dir", ""));
+	key = hash_str(key, deadbeef->conf_get_str_fast("ddw.host_cmd", "ddw_host.exe"));
+	deadbeef->conf_unlock();
+
+	if (dir == NULL || *dir == '\0')
+		goto out;
+
+	// streams have no end to cache up to
+	duration = deadbeef->pl_get_item_duration(it);
+	if (duration <= 0.0f)
+		goto out;
+
+	key = hash_str(key, self->pl->dll);
+	key = hash64(key, &self->pl->max_bps, sizeof(self->pl->max_bps));
+	key = hash64(key, &duration, sizeof(duration));
+
+	deadbeef->pl_lock();
+	key = hash_str(key, deadbeef->pl_find_meta(it, ":URI"));
+	key = hash_str(key, deadbeef->pl_find_meta(it, ":FILE_SIZE"));
+	key = hash_str(key, deadbeef->pl_find_meta(it, "track"));
+	deadbeef->pl_unlock();
+
+	if (asprintf(&self->cache_path, "%s/%016llx.ddwr", dir, (unsigned long long)key) == -1) {
+		self->cache_path = NULL;
+		goto out;
+	}
+
+	self->cache_frames_in = 0;
+	self->cache_frames_want = (uint64_t)(duration*fmt->samplerate);
+	self->cache_slack = (uint64_t)fmt->samplerate*CACHE_SLACK_MS/1000;
+
+	//
+	// the track starts from an empty host either way, so what's saved is
+	//  only this track's own output, and what's played back from it is
+	//  the same as a live start. what the host and the fifo still had of
+	//  the last track is dropped
+	//
+	child_send_command(self, DDW_CMD_RESET, 0);
+
+	if (!cache_open_map(self, key))
+		cache_open_out(self, key);
+out:
+	free(dir);
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// child_process_samples() through the cache
+//
+int
+cache_process(struct child *self,
+              ddb_waveformat_t *fmt,
+              const ddb_waveformat_t *nextfmt,
+              char *data,
+              int frames_in,
+              size_t datacap)
+{
+	DB_playItem_t *it;
+	uint64_t hash;
+	int frames_out;
+
+	if (!self->cache_on || !ddw_has_dll(self->pl))
+		return child_process_samples(self, fmt, nextfmt, data, frames_in, datacap);
+
+	// (the reference is kept, so a new track can't get the old one's address)
+	it = deadbeef->streamer_get_streaming_track();
+	if (it != self->cache_track) {
+		if (self->cache_track != NULL)
+			deadbeef->pl_item_unref(self->cache_track);
+		self->cache_track = it;
+		if (it != NULL)
+			cache_begin(self, it, fmt);
+	} else if (it != NULL) {
+		deadbeef->pl_item_unref(it);
+	}
+
+	if (self->cache_map == NULL && self->cache_out == NULL)
+		return child_process_samples(self, fmt, nextfmt, data, frames_in, datacap);
+
+	hash = block_hash(fmt, nextfmt, data, frames_in);
+
+	if (self->cache_map != NULL) {
+		struct cache_rec rec;
+		const char *p = (const char *)self->cache_map+self->cache_pos;
+		size_t left = self->cache_mapsz-self->cache_pos;
+
+		if (left >= sizeof(rec)) {
+			memcpy(&rec, p, sizeof(rec));
+
+			if (rec.hash == hash &&
+			    rec.frames_in == (uint32_t)frames_in &&
+			    rec.out_size <= datacap &&
+			    rec.out_size <= left-sizeof(rec)) {
+				memcpy(data, p+sizeof(rec), rec.out_size);
+				self->cache_pos += sizeof(rec)+rec.out_size;
+				*fmt = *nextfmt;
+				return fmt_bytes2frames(nextfmt, rec.out_size);
+			}
+		}
+
+		// the host hasn't seen any of it, so what it has is from before
+		fprintf(stderr, "dsp_winamp: cache ends or doesn't match, processing live\n");
+		cache_unmap(self);
+		child_send_command(self, DDW_CMD_RESET, 0);
+	}
+
+	frames_out = child_process_samples(self, fmt, nextfmt, data, frames_in, datacap);
+
+	if (self->cache_out != NULL) {
+		struct cache_rec rec = {
+			.hash = hash,
+			.frames_in = frames_in,
+			.out_size = (frames_out > 0) ? fmt_frames2bytes(nextfmt, frames_out) : 0,
+		};
+
+		if (frames_out < 0)
+			cache_abandon(self, "processing failed");
+		else if (self->nocache)
+			cache_abandon(self, "a dll in the chain has nocache");
+
+		if (self->cache_out != NULL) {
+			if (fwrite(&rec, sizeof(rec), 1, self->cache_out) != 1 ||
+			    fwrite(data, 1, rec.out_size, self->cache_out) != rec.out_size) {
+				perror("dsp_winamp: cache: fwrite");
+				cache_abandon(self, NULL);
+			} else {
+				self->cache_frames_in += frames_in;
+			}
+		}
+	}
+
+	return frames_out;
+}
+
+//
+// seek or stop: what's being played isn't the start of a track anymore.
+//  back to live processing until the next track. also re-reads whether
+//  ddw.cache_dir is set
+//
+void
+cache_reset(struct child *self)
+{
+	deadbeef->conf_lock();
+	self->cache_on = (*deadbeef->conf_get_str_fast("ddw.cache_dir", "") != '\0');
+	deadbeef->conf_unlock();
+
+	cache_finish(self);
+	cache_unmap(self);
+}
+
+void
+cache_close(struct child *self)
+{
+	cache_finish(self);
+	cache_unmap(self);
+	free(self->cache_path);
+	self->cache_path = NULL;
+	if (self->cache_track != NULL)
+		deadbeef->pl_item_unref(self->cache_track);
+	self->cache_track = NULL;
+}
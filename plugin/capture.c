@@ -0,0 +1,105 @@
+#include "child.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capturedata.h"
+#include "plugin.h"
+
+#define CAPTURE_BUFSZ (1024*1024)
+
+// -----------------------------------------------------------------------------
+
+//
+// start capturing if ddw.capture_dir is set. one file per dsp instance, kept
+//  open across host restarts
+//
+bool
+capture_open(struct child *self)
+{
+	static unsigned int counter = 0;
+	struct capture_header hdr = {0};
+	char path[512];
+	char *dir;
+
+	if (self->capture != NULL)
+		return true;
+
+	deadbeef->conf_lock();
+	dir = strdup(deadbeef->conf_get_str_fast("ddw.capture_dir", ""));
+	deadbeef->conf_unlock();
+
+	if (dir == NULL || *dir == '\0') {
+		free(dir);
+		return true;
+	}
+
+	snprintf(path, sizeof(path), "%s/ddw_capture.%d.%ld.%u.ddwc",
+	    dir, getpid(), (long)time(NULL),
+	    __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+	free(dir);
+
+	self->capture = fopen(path, "we");
+	if (self->capture == NULL) {
+		perror("dsp_winamp: capture_open: fopen");
+		return false;
+	}
+	setvbuf(self->capture, NULL, _IOFBF, CAPTURE_BUFSZ);
+
+	memcpy(hdr.magic, CAPTURE_MAGIC, sizeof(hdr.magic));
+	snprintf(hdr.dll, sizeof(hdr.dll), "%s", self->pl->dll);
+
+	if (fwrite(&hdr, sizeof(hdr), 1, self->capture) != 1) {
+		perror("dsp_winamp: capture_open: fwrite");
+		capture_close(self);
+		return false;
+	}
+	self->capture_start_ns = 0;
+
+	fprintf(stderr, "dsp_winamp: capturing requests to %s\n", path);
+
+	return true;
+}
+
+void
+capture_close(struct child *self)
+{
+	if (self->capture == NULL)
+		return;
+
+	if (fclose(self->capture) != 0)
+		perror("dsp_winamp: capture_close: fclose");
+	self->capture = NULL;
+}
+
+//
+// add a request to the capture. stops capturing if the write fails
+//
+void
+capture_write(struct child *self,
+              const struct processing_request *req,
+              const char *pcm,
+              uint64_t time_ns)
+{
+	struct capture_rec rec;
+
+	if (self->capture == NULL)
+		return;
+
+	if (self->capture_start_ns == 0)
+		self->capture_start_ns = time_ns;
+
+	rec = (struct capture_rec){
+		.time_ns = time_ns-self->capture_start_ns,
+		.req = *req,
+	};
+
+	if (fwrite(&rec, sizeof(rec), 1, self->capture) != 1 ||
+	    (req->command == DDW_CMD_PROCESS &&
+	     fwrite(pcm, 1, req->buffer_size, self->capture) != req->buffer_size)) {
+		perror("dsp_winamp: capture_write: fwrite");
+		capture_close(self);
+	}
+}
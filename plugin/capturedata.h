@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ddw.h"
+
+//
+// capture file: a copy of everything the plugin wrote to the host's stdin,
+//  with the time each request was sent
+//
+// written by the plugin when ddw.capture_dir is set, read by ddw_replay
+//  (tools/) to play it back to a host
+//
+// layout: one capture_header, then for every request a capture_rec
+//  followed by req.buffer_size bytes of pcm, until the end of the file.
+//  resets, flushes and silence are in there too, with no pcm
+//
+
+#define CAPTURE_MAGIC "ddwcap03"
+
+struct __attribute__((packed)) capture_header {
+	char magic[8];
+	char dll[256]; // the dll argument the host was started with
+};
+
+struct __attribute__((packed)) capture_rec {
+	uint64_t time_ns; // since the first request, CLOCK_MONOTONIC
+	struct processing_request req;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #include <deadbeef/deadbeef.h>
 
@@ -17,6 +19,59 @@ struct child {
 	bool killmenow;
 
 	struct ddw *pl;
+
+	// flight recorder shared with the host (flight.c)
+	struct flightdata *flight;
+	char flightname[64];
+
+	// copy of the request stream if ddw.capture_dir is set (capture.c)
+	FILE *capture;
+	uint64_t capture_start_ns;
+
+	// audio held in the host as of the last block, and that plus the fifo
+	//  and held input below as published (latency.c)
+	int host_latency_ms;
+	int latency_ms;
+
+	// output that didn't fit in deadbeef's buffer yet, in fifo_fmt
+	char *fifo;
+	size_t fifo_sz;
+	size_t fifo_cap;
+	ddb_waveformat_t fifo_fmt;
+
+	// input not sent to the host yet because the fifo was full, in held_fmt
+	char *held;
+	size_t held_sz;
+	size_t held_cap;
+	ddb_waveformat_t held_fmt;
+
+	// for converting to and from the host's format, not kept between calls
+	char *scratch;
+	size_t scratch_cap;
+
+	// the host said none of its dlls run at inactive_fmt (deadbeef's
+	//  format, before any conversion for the host)
+	bool inactive;
+	ddb_waveformat_t inactive_fmt;
+
+	// the host said a dll gives different output for the same input
+	bool nocache;
+
+	// sched_host_started() has been done for this host
+	bool sched_done;
+
+	// render cache if ddw.cache_dir is set (cache.c)
+	bool cache_on;
+	DB_playItem_t *cache_track; // referenced
+	char *cache_path;
+	void *cache_map; // playing back from here
+	size_t cache_mapsz;
+	size_t cache_pos;
+	FILE *cache_out; // or writing it
+	char *cache_tmppath;
+	uint64_t cache_frames_in;
+	uint64_t cache_frames_want;
+	uint64_t cache_slack;
 };
 #define CHILD_INITIALIZER(plz) (struct child){.pid = -1, .fds = {-1, -1}, .pl = plz}
 
@@ -31,6 +86,59 @@ void child_record_failure(struct child *self);
 bool child_is_doomed(struct child *self);
 void child_reset_failures(struct child *self);
 
+/// flight.c
+
+bool flight_open(struct child *self);
+void flight_close(struct child *self);
+
+struct rusage;
+
+uint64_t flight_now_ns(void);
+void flight_record(struct child *self,
+                   const ddb_waveformat_t *fmt,
+                   int frames_in,
+                   int frames_out,
+                   uint64_t start_ns,
+                   const struct rusage *start_ru);
+void flight_dump(struct child *self, const char *why);
+
+/// capture.c
+
+struct processing_request;
+
+bool capture_open(struct child *self);
+void capture_close(struct child *self);
+void capture_write(struct child *self,
+                   const struct processing_request *req,
+                   const char *pcm,
+                   uint64_t time_ns);
+
+/// cache.c
+
+int cache_process(struct child *self,
+                  ddb_waveformat_t *fmt,
+                  const ddb_waveformat_t *nextfmt,
+                  char *data,
+                  int frames_in,
+                  size_t datacap);
+void cache_reset(struct child *self);
+void cache_close(struct child *self);
+
+/// sched.c
+
+void sched_host_started(struct child *self);
+void sched_pin_streamer(void);
+
+/// memlock.c
+
+void memlock_region(void *p, size_t sz);
+void memlock_unlock(void *p, size_t sz);
+void memlock_streamer(void);
+
+/// latency.c
+
+void latency_set(struct child *self, int ms);
+
 /// chldproc.c
 
 int child_process_samples(struct child *self,
@@ -39,3 +147,7 @@ int child_process_samples(struct child *self,
                           char *data,
                           int frames_in,
                           size_t datacap);
+bool child_send_command(struct child *self, uint8_t command, uint32_t flush_ms);
+bool child_is_inactive(struct child *self, const ddb_waveformat_t *fmt);
+void child_drop_buffered(struct child *self);
+void child_free_buffers(struct child *self);
@@ -36,6 +36,8 @@ bool
 child_start(struct child *self)
 {
 	char *host = NULL;
+	char prio[32], cpus[128], tcpus[128];
+	bool lockmem, countfaults;
 	int stdin[2] = {-1, -1},
 	    stdout[2] = {-1, -1}; // {read_end, write_end}
 	pid_t pid = -1;
@@ -46,14 +48,26 @@ child_start(struct child *self)
 	assert(self->fds[0] == -1);
 	assert(self->fds[1] == -1);
 
+	// keeps going without it if this fails
+	if (!flight_open(self))
+		fprintf(stderr, "dsp_winamp: warning: flight recorder not available\n");
+	if (!capture_open(self))
+		fprintf(stderr, "dsp_winamp: warning: not capturing requests\n");
+
 	if (pipe(stdin) < 0 || pipe(stdout) < 0) {
 		perror("dsp_winamp: pipe");
 		goto failed;
 	}
 
+	// (for host/sched.c and host/memlock.c)
 	deadbeef->conf_lock();
 	host = strdup(deadbeef->conf_get_str_fast("ddw.host_cmd", "ddw_host.exe"));
+	snprintf(prio, sizeof(prio), "%s", deadbeef->conf_get_str_fast("ddw.host_priority", ""));
+	snprintf(cpus, sizeof(cpus), "%s", deadbeef->conf_get_str_fast("ddw.host_cpus", ""));
+	snprintf(tcpus, sizeof(tcpus), "%s", deadbeef->conf_get_str_fast("ddw.host_thread_cpus", ""));
 	deadbeef->conf_unlock();
+	lockmem = deadbeef->conf_get_int("ddw.lock_memory", 0);
+	countfaults = deadbeef->conf_get_int("ddw.count_faults", 0);
 	assert(host != NULL);
 
 	pid = fork();
@@ -75,6 +89,18 @@ failed:
 			_exit(EXIT_FAILURE);
 		}
 		close_extra();
+		if (self->flight != NULL)
+			setenv("DDW_FLIGHT_NAME", self->flightname, 1);
+		if (prio[0] != '\0')
+			setenv("DDW_PRIORITY", prio, 1);
+		if (cpus[0] != '\0')
+			setenv("DDW_AFFINITY", cpus, 1);
+		if (tcpus[0] != '\0')
+			setenv("DDW_THREAD_AFFINITY", tcpus, 1);
+		if (lockmem)
+			setenv("DDW_LOCK_MEMORY", "1", 1);
+		if (countfaults)
+			setenv("DDW_COUNT_FAULTS", "1", 1);
 		bufsz = strlen("exec ") + strlen(host) + strlen(" ") + strlen(self->pl->dll) + sizeof('\0');
 		cmd = alloca(bufsz);
 		snprintf(cmd, bufsz, "exec %s %s", host, self->pl->dll);
@@ -196,6 +222,10 @@ out:
 		return false;
 
 	self->killmenow = false;
+	self->inactive = false;
+	self->sched_done = false;
+	self->host_latency_ms = 0;
+	latency_set(self, 0);
 
 	if (self->fds[0] != -1) {
 		close(self->fds[0]);
@@ -3,7 +3,9 @@
 #include <assert.h>
 #include <alloca.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/uio.h>
 
 #include "ddw.h"
@@ -93,18 +95,197 @@ pcm_convert_s(const ddb_waveformat_t *const infmt,
 
 // -----------------------------------------------------------------------------
 
+//
+// the host can give back more than fits in deadbeef's buffer (a dll that
+//  stretches, or the host batching). the rest waits in self->fifo for the
+//  next calls
+//
+// while the fifo has enough for a whole call, the input isn't sent to the
+//  host but kept in self->held, so a host that keeps producing more than
+//  deadbeef takes doesn't make the fifo grow forever. up to HOLD_MAX_MS of
+//  it, then it's sent anyway
+//
+
+#define HOLD_MAX_MS 250
+
+static bool
+grow(char **p, size_t *cap, size_t need)
+{
+	char *newp;
+
+	if (*cap >= need)
+		return true;
+
+	need = (need > *cap*2) ? need : *cap*2;
+	memlock_unlock(*p, *cap);
+	newp = realloc(*p, need);
+	if (newp == NULL) {
+		perror("dsp_winamp: realloc");
+		return false;
+	}
+	memlock_region(newp, need);
+
+	*p = newp;
+	*cap = need;
+
+	return true;
+}
+
+//
+// make room for sz more bytes in the fifo, in format fmt
+//
+static bool
+fifo_reserve(struct child *self, const ddb_waveformat_t *fmt, size_t sz)
+{
+	if (self->fifo_sz != 0 && memcmp(&self->fifo_fmt, fmt, sizeof(ddb_waveformat_t)) != 0) {
+		fprintf(stderr, "dsp_winamp: output format changed, dropping %zu buffered frames\n",
+		    fmt_bytes2frames(&self->fifo_fmt, self->fifo_sz));
+		self->fifo_sz = 0;
+	}
+	self->fifo_fmt = *fmt;
+
+	return grow(&self->fifo, &self->fifo_cap, self->fifo_sz+sz);
+}
+
+//
+// give as much of the fifo to deadbeef as fits
+//
+static int
+fifo_take(struct child *self, char *data, size_t datacap)
+{
+	int frames = fmt_bytes2frames(&self->fifo_fmt, MIN(self->fifo_sz, datacap));
+	size_t sz = fmt_frames2bytes(&self->fifo_fmt, frames);
+
+	memcpy(data, self->fifo, sz);
+	memmove(self->fifo, self->fifo+sz, self->fifo_sz-sz);
+	self->fifo_sz -= sz;
+
+	return frames;
+}
+
+//
+// can the fifo fill this whole call by itself?
+//
+static bool
+fifo_covers(struct child *self, const ddb_waveformat_t *nextfmt, size_t datacap)
+{
+	if (self->fifo_sz == 0 || memcmp(&self->fifo_fmt, nextfmt, sizeof(ddb_waveformat_t)) != 0)
+		return false;
+
+	return self->fifo_sz >= datacap - datacap%fmt_frames2bytes(nextfmt, 1);
+}
+
+//
+// keep the input for later. with `force` past HOLD_MAX_MS too
+//
+static bool
+hold(struct child *self, const ddb_waveformat_t *fmt, const char *data, int frames, bool force)
+{
+	size_t sz = fmt_frames2bytes(fmt, frames);
+
+	if (self->held_sz != 0 && memcmp(&self->held_fmt, fmt, sizeof(ddb_waveformat_t)) != 0)
+		return false;
+
+	if (!force &&
+	    self->held_sz+sz > fmt_frames2bytes(fmt, fmt->samplerate*HOLD_MAX_MS/1000))
+		return false;
+
+	if (!grow(&self->held, &self->held_cap, self->held_sz+sz))
+		return false;
+
+	memcpy(self->held+self->held_sz, data, sz);
+	self->held_sz += sz;
+	self->held_fmt = *fmt;
+
+	return true;
+}
+
+//
+// what's in the fifo and held counts as latency too, it's audio that went
+//  into the dsp chain and hasn't come out yet
+//
+static void
+update_latency(struct child *self)
+{
+	uint64_t ms = self->host_latency_ms;
+
+	if (self->fifo_sz != 0)
+		ms += (uint64_t)fmt_bytes2frames(&self->fifo_fmt, self->fifo_sz)*1000/self->fifo_fmt.samplerate;
+	if (self->held_sz != 0)
+		ms += (uint64_t)fmt_bytes2frames(&self->held_fmt, self->held_sz)*1000/self->held_fmt.samplerate;
+
+	latency_set(self, (int)ms);
+}
+
+void
+child_drop_buffered(struct child *self)
+{
+	self->fifo_sz = 0;
+	self->held_sz = 0;
+	update_latency(self);
+}
+
+void
+child_free_buffers(struct child *self)
+{
+	memlock_unlock(self->fifo, self->fifo_cap);
+	memlock_unlock(self->held, self->held_cap);
+	memlock_unlock(self->scratch, self->scratch_cap);
+	free(self->fifo);
+	free(self->held);
+	free(self->scratch);
+	self->fifo = NULL;
+	self->held = NULL;
+	self->scratch = NULL;
+	self->fifo_sz = self->fifo_cap = 0;
+	self->held_sz = self->held_cap = 0;
+	self->scratch_cap = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// is it all zero bytes? (digital silence in any of the formats). the same as
+//  is_zero() in host/misc.c, which isn't built for this side
+//
+static bool
+is_zero(const char *p, size_t sz)
+{
+	uint64_t acc = 0;
+	size_t i = 0;
+
+	for (; i+64 <= sz; i += 64) {
+		uint64_t w[8];
+
+		memcpy(w, p+i, sizeof(w));
+		for (int j = 0; j < 8; j++)
+			acc |= w[j];
+		if (acc != 0)
+			return false;
+	}
+	for (; i < sz; i++)
+		acc |= (unsigned char)p[i];
+
+	return acc == 0;
+}
+
+//
+// silence is sent as DDW_CMD_SILENCE with just the header
+//
 static bool
 do_write(struct child *self,
          ddb_waveformat_t *fmt,
-         char *data,
+         const char *data,
          int frames)
 {
 	struct processing_request request;
 	const char *writebuf;
 	struct iovec iov[2];
+	int iovcnt;
 	ssize_t write_rv;
 
 	bool bps_over = (self->pl->max_bps != 0 && fmt->bps > self->pl->max_bps);
+	bool silent = is_zero(data, fmt_frames2bytes(fmt, frames));
 
 	//
 	// need to convert before writing?
@@ -112,21 +293,27 @@ do_write(struct child *self,
 	if (fmt->is_float || bps_over) {
 
 		ddb_waveformat_t convfmt = *fmt;
-		char *p;
+		size_t convsz;
 
 		if (bps_over)
 			convfmt.bps = self->pl->max_bps;
 		convfmt.is_float = 0;
-
-		p = alloca(fmt_frames2bytes(&convfmt, frames));
-		pcm_convert_s(
-		    fmt, data, frames,
-		    &convfmt, p, fmt_frames2bytes(&convfmt, frames));
+		convsz = fmt_frames2bytes(&convfmt, frames);
+
+		// (zeros are zeros in every format)
+		if (!silent) {
+			// (on the heap, held input sent anyway can be any size)
+			if (!grow(&self->scratch, &self->scratch_cap, convsz))
+				return false;
+			pcm_convert_s(
+			    fmt, data, frames,
+			    &convfmt, self->scratch, convsz);
+		}
 
 		fmt->bps = convfmt.bps;
 		fmt->is_float = convfmt.is_float;
 
-		writebuf = p;
+		writebuf = (silent) ? NULL : self->scratch;
 
 	} else {
 
@@ -139,6 +326,7 @@ do_write(struct child *self,
 		.samplerate = fmt->samplerate,
 		.bitspersample = fmt->bps,
 		.channels = fmt->channels,
+		.command = (silent) ? DDW_CMD_SILENCE : DDW_CMD_PROCESS,
 	};
 
 	iov[0] = (struct iovec){
@@ -147,12 +335,13 @@ do_write(struct child *self,
 	};
 	iov[1] = (struct iovec){
 		.iov_base = (void *)writebuf,
-		.iov_len = request.buffer_size,
+		.iov_len = (silent) ? 0 : request.buffer_size,
 	};
+	iovcnt = (silent) ? 1 : 2;
 
 writeagain:
 	errno = 0;
-	write_rv = writev(self->fds[1], iov, 2);
+	write_rv = writev(self->fds[1], iov, iovcnt);
 
 	if (write_rv == -1) {
 		if (errno == EINTR)
@@ -176,9 +365,15 @@ writeagain:
 		return false;
 	}
 
+	capture_write(self, &request, (silent) ? NULL : writebuf, flight_now_ns());
+
 	return true;
 }
 
+//
+// read the response to `data`, or to the fifo if it doesn't fit or the fifo
+//  has something already. returns how many frames went to `data`
+//
 static int
 do_read(struct child *self,
          ddb_waveformat_t *fmt,
@@ -188,44 +383,72 @@ do_read(struct child *self,
 {
 	struct processing_response response;
 	int frames_read = -1;
+	size_t outsz;
+	char *dst;
+	size_t dstcap;
 
 	if (!read_full(self->fds[0], &response, sizeof(response)))
 		goto readerr;
 
 	frames_read = fmt_bytes2frames(fmt, response.buffer_size);
+	outsz = fmt_frames2bytes(nextfmt, frames_read);
 
-	//
-	// output needs to be in a different format?
-	//
-	if (memcmp(nextfmt, fmt, sizeof(ddb_waveformat_t)) != 0) {
+	self->host_latency_ms = (int)((uint64_t)response.latency_frames*1000/fmt->samplerate);
+	self->inactive = response.inactive;
+	self->nocache = response.nocache;
 
-		char *readbuf = alloca(response.buffer_size);
+	if (self->fifo_sz == 0 && outsz <= datacap) {
+		dst = data;
+		dstcap = datacap;
+	} else {
+		// (can't leave it in the pipe)
+		if (!fifo_reserve(self, nextfmt, outsz))
+			goto err;
+		dst = self->fifo+self->fifo_sz;
+		dstcap = self->fifo_cap-self->fifo_sz;
+	}
+
+	if (response.silent) {
+
+		// nothing to read, and zeros don't need converting
+		memset(dst, 0, outsz);
+
+		*fmt = *nextfmt;
+
+	} else if (memcmp(nextfmt, fmt, sizeof(ddb_waveformat_t)) != 0) {
+
+		// output needs to be in a different format
+		if (!grow(&self->scratch, &self->scratch_cap, response.buffer_size))
+			goto err;
 
-		if (!read_full(self->fds[0], readbuf, response.buffer_size))
+		if (!read_full(self->fds[0], self->scratch, response.buffer_size))
 			goto readerr;
 
 		pcm_convert_s(
-		    fmt, readbuf, frames_read,
-		    nextfmt, data, datacap);
+		    fmt, self->scratch, frames_read,
+		    nextfmt, dst, dstcap);
 
 		*fmt = *nextfmt;
 
 	} else {
 
-		assert(datacap >= response.buffer_size);
-
-		if (!read_full(self->fds[0], data, response.buffer_size))
+		if (!read_full(self->fds[0], dst, response.buffer_size))
 			goto readerr;
 
 	}
 
-	return frames_read;
+	if (dst == data)
+		return frames_read;
+
+	self->fifo_sz += outsz;
+
+	return fifo_take(self, data, datacap);
 readerr:
 	if (errno != 0)
 		perror("read");
 	else
 		fprintf(stderr, "read: unexpected EOF\n");
-
+err:
 	self->killmenow = true;
 
 	return -1;
@@ -256,6 +479,58 @@ just_convert(struct child *self,
 
 // -----------------------------------------------------------------------------
 
+//
+// one request and response. `in` and `data` can be the same buffer
+//
+static int
+send_block(struct child *self,
+           ddb_waveformat_t *fmt,
+           const ddb_waveformat_t *nextfmt,
+           const char *in,
+           int frames_in,
+           char *data,
+           size_t datacap,
+           bool *started)
+{
+	const ddb_waveformat_t infmt = *fmt;
+	uint64_t start_ns = flight_now_ns();
+	struct rusage start_ru;
+	ddb_waveformat_t wfmt;
+	int frames_out;
+
+	getrusage(RUSAGE_THREAD, &start_ru);
+
+	//
+	// if the write fails, try restarting the child and retrying the write
+	//
+write_again:
+	wfmt = *fmt;
+	if (!do_write(self, &wfmt, in, frames_in)) {
+		if (*started)
+			return -1;
+
+		flight_dump(self, "write to host failed, restarting it");
+		child_stop(self);
+
+		if (!child_start(self))
+			return -1;
+
+		*started = true;
+
+		goto write_again;
+	}
+	*fmt = wfmt;
+
+	frames_out = do_read(self, fmt, nextfmt, data, datacap);
+
+	if (self->inactive)
+		self->inactive_fmt = infmt;
+
+	flight_record(self, &infmt, frames_in, frames_out, start_ns, &start_ru);
+
+	return frames_out;
+}
+
 int
 child_process_samples(struct child *self,
                       ddb_waveformat_t *fmt,
@@ -281,33 +556,124 @@ child_process_samples(struct child *self,
 		started = true;
 	}
 
+	// nothing for the host to do, same as not having a dll
+	if (child_is_inactive(self, fmt)) {
+		frames_out = just_convert(self, fmt, nextfmt, data, frames_in, datacap);
+		goto out;
+	}
+
+	// enough output waiting for all of this call, keep the input for later
+	if (fifo_covers(self, nextfmt, datacap) &&
+	    hold(self, fmt, data, frames_in, false)) {
+		*fmt = *nextfmt;
+		frames_out = fifo_take(self, data, datacap);
+		goto out;
+	}
+
 	//
-	// if the write fails, try restarting the child and retrying the write
+	// input held from before goes first. if the format changed it's sent
+	//  by itself and what comes out goes to the fifo, otherwise the new
+	//  input is added to it
 	//
-write_again:
-	if (!do_write(self, fmt, data, frames_in)) {
-		if (started)
-			goto out;
-
-		child_stop(self);
+	if (self->held_sz != 0 && !hold(self, fmt, data, frames_in, true)) {
+		ddb_waveformat_t heldfmt = self->held_fmt;
 
-		if (!child_start(self))
+		if (send_block(self, &heldfmt, nextfmt,
+		    self->held, fmt_bytes2frames(&self->held_fmt, self->held_sz),
+		    data, 0, &started) < 0)
 			goto out;
-
-		started = true;
-
-		goto write_again;
+		self->held_sz = 0;
 	}
 
-	frames_out = do_read(self, fmt, nextfmt, data, datacap);
+	if (self->held_sz != 0) {
+		frames_out = send_block(self, fmt, nextfmt,
+		    self->held, fmt_bytes2frames(&self->held_fmt, self->held_sz),
+		    data, datacap, &started);
+		if (frames_out >= 0)
+			self->held_sz = 0;
+	} else {
+		frames_out = send_block(self, fmt, nextfmt,
+		    data, frames_in,
+		    data, datacap, &started);
+	}
 out:
 	if (frames_out >= 0) {
+		update_latency(self);
 		child_record_success(self);
+		if (self->pid != -1)
+			sched_host_started(self);
 	} else {
 		child_record_failure(self);
-		if (self->killmenow)
+		if (self->killmenow) {
+			flight_dump(self, "host failed");
 			child_stop(self);
+		}
 	}
 
 	return frames_out;
 }
+
+//
+// true if the host has said that none of its dlls run at this format, and
+//  there's nothing of it buffered here. then the blocks don't need to be sent
+//  to it until the format changes
+//
+bool
+child_is_inactive(struct child *self, const ddb_waveformat_t *fmt)
+{
+	return self->inactive &&
+	    self->fifo_sz == 0 &&
+	    self->held_sz == 0 &&
+	    memcmp(&self->inactive_fmt, fmt, sizeof(ddb_waveformat_t)) == 0;
+}
+
+//
+// DDW_CMD_RESET or DDW_CMD_FLUSH. does nothing if the host isn't running,
+//  it'll start out empty anyway. if the host doesn't answer it's stopped so
+//  the next block starts a new one
+//
+bool
+child_send_command(struct child *self, uint8_t command, uint32_t flush_ms)
+{
+	struct processing_request request = {
+		.command = command,
+		.flush_ms = flush_ms,
+	};
+	struct processing_response response;
+
+	// what's in the plugin is from before too
+	child_drop_buffered(self);
+
+	if (self->pid == -1)
+		return true;
+
+	if (!write_full(self->fds[1], &request, sizeof(request))) {
+		perror("dsp_winamp: write");
+		goto err;
+	}
+
+	capture_write(self, &request, NULL, flight_now_ns());
+
+	if (!read_full(self->fds[0], &response, sizeof(response))) {
+		if (errno != 0)
+			perror("read");
+		else
+			fprintf(stderr, "read: unexpected EOF\n");
+		goto err;
+	}
+
+	if (response.buffer_size != 0) {
+		fprintf(stderr, "dsp_winamp: host answered a reset with %llu bytes\n",
+		    (unsigned long long)response.buffer_size);
+		goto err;
+	}
+
+	self->host_latency_ms = 0;
+	update_latency(self);
+
+	return true;
+err:
+	flight_dump(self, "reset failed");
+	child_stop(self);
+	return false;
+}
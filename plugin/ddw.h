@@ -2,13 +2,35 @@
 
 #include <stdint.h>
 
+enum {
+	DDW_CMD_PROCESS = 0, /* run the pcm after the header through the chain */
+	DDW_CMD_SILENCE = 3, /* same but the pcm is buffer_size bytes of zeros,
+	                        which aren't sent */
+
+	/* no pcm after the header, answered with an empty response */
+	DDW_CMD_RESET = 1, /* throw out the audio buffered in the host */
+	DDW_CMD_FLUSH = 2, /* run flush_ms of silence through the dlls first so
+	                      their tails die out, then the same as reset */
+};
+
 struct __attribute__((__packed__)) processing_request {
 	uint64_t buffer_size; /* how many bytes are written after this header */
 	uint32_t samplerate;
 	uint8_t bitspersample;
 	uint8_t channels;
+	uint8_t command; /* DDW_CMD_* */
+	uint32_t flush_ms; /* for DDW_CMD_FLUSH */
 };
 
 struct __attribute__((__packed__)) processing_response {
 	uint64_t buffer_size; /* how many bytes are written after this header */
+	uint32_t latency_frames; /* audio held in the host after this, at the
+	                            request's rate */
+	uint8_t silent; /* the pcm is buffer_size bytes of zeros, which aren't
+	                   sent. only as an answer to DDW_CMD_SILENCE */
+	uint8_t inactive; /* none of the dlls run at the request's format, so
+	                     the pcm came back as it was. it doesn't need to be
+	                     sent again until the format changes */
+	uint8_t nocache; /* a dll gives different output for the same input, so
+	                    don't save it for later */
 };
@@ -0,0 +1,143 @@
+#include "child.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flightdata.h"
+#include "plugin.h"
+
+// -----------------------------------------------------------------------------
+
+bool
+flight_open(struct child *self)
+{
+	static unsigned int counter = 0;
+	struct flightdata *fd = MAP_FAILED;
+	int fildes;
+
+	if (self->flight != NULL)
+		return true;
+
+	snprintf(self->flightname, sizeof(self->flightname), "/dev/shm/ddw_flight.%d.%u",
+	    getpid(), __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+
+	fildes = open(self->flightname, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0600);
+	if (fildes == -1) {
+		perror("dsp_winamp: flight_open: open");
+		goto out;
+	}
+
+	if (ftruncate(fildes, sizeof(struct flightdata)) == -1) {
+		perror("dsp_winamp: flight_open: ftruncate");
+		goto out;
+	}
+
+	fd = mmap(NULL, sizeof(struct flightdata), PROT_READ|PROT_WRITE, MAP_SHARED, fildes, 0);
+	if (fd == MAP_FAILED) {
+		perror("dsp_winamp: flight_open: mmap");
+		goto out;
+	}
+
+	memcpy(fd->magic, FLIGHT_MAGIC, sizeof(fd->magic));
+	memlock_region(fd, sizeof(struct flightdata));
+	self->flight = fd;
+out:
+	if (fildes != -1)
+		close(fildes);
+	if (self->flight == NULL && fildes != -1)
+		unlink(self->flightname);
+
+	return self->flight != NULL;
+}
+
+void
+flight_close(struct child *self)
+{
+	if (self->flight == NULL)
+		return;
+
+	munmap(self->flight, sizeof(struct flightdata));
+	self->flight = NULL;
+
+	if (unlink(self->flightname) == -1)
+		perror("dsp_winamp: flight_close: unlink");
+}
+
+uint64_t
+flight_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void
+flight_record(struct child *self,
+              const ddb_waveformat_t *fmt,
+              int frames_in,
+              int frames_out,
+              uint64_t start_ns,
+              const struct rusage *start_ru)
+{
+	struct flightdata *fd = self->flight;
+	struct rusage ru;
+
+	if (fd == NULL)
+		return;
+
+	getrusage(RUSAGE_THREAD, &ru);
+
+	fd->plugin[fd->plugin_seq % FLIGHT_RECORDS] = (struct flight_plugin_rec){
+		.time_ns = start_ns,
+		.seq = fd->plugin_seq,
+		.rate = fmt->samplerate,
+		.bps = fmt->bps,
+		.ch = fmt->channels,
+		.is_float = fmt->is_float,
+		.frames_in = frames_in,
+		.frames_out = frames_out,
+		.duration_us = (flight_now_ns()-start_ns)/1000,
+		.minflt = ru.ru_minflt-start_ru->ru_minflt,
+		.majflt = ru.ru_majflt-start_ru->ru_majflt,
+	};
+	fd->plugin_seq++;
+}
+
+//
+// write the records of both sides to a file in $TMPDIR
+//
+void
+flight_dump(struct child *self, const char *why)
+{
+	const char *dir = getenv("TMPDIR") ?: "/tmp";
+	char path[256];
+	FILE *f;
+
+	if (self->flight == NULL)
+		return;
+	if (self->flight->plugin_seq == 0 && self->flight->host_seq == 0)
+		return;
+
+	snprintf(path, sizeof(path), "%s/ddw_flight.%d.%ld.txt",
+	    dir, getpid(), (long)time(NULL));
+
+	f = fopen(path, "we");
+	if (f == NULL) {
+		perror("dsp_winamp: flight_dump: fopen");
+		return;
+	}
+
+	fprintf(f, "# %s\n", why);
+	fprintf(f, "# dll: %s\n", self->pl->dll);
+	flight_print(f, self->flight);
+	fclose(f);
+
+	fprintf(stderr, "dsp_winamp: %s, flight recorder dumped to %s\n", why, path);
+}
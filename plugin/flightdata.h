@@ -0,0 +1,131 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// flight recorder: the last FLIGHT_RECORDS blocks seen by each side
+//
+// the plugin creates this as a file in /dev/shm and passes its name to the
+//  host in DDW_FLIGHT_NAME. both sides write their records into it, so the
+//  host's records survive it crashing and the plugin can dump everything to
+//  a text file when the host dies or is restarted
+//
+// timestamps are in ns but from different clocks: CLOCK_MONOTONIC on the
+//  plugin side and QueryPerformanceCounter() on the host side
+//
+
+#define FLIGHT_MAGIC "ddwflt03"
+#define FLIGHT_RECORDS 256
+#define FLIGHT_MAX_PLUGINS 16
+
+// in flight_host_rec.faults if the host wasn't counting them
+#define FLIGHT_NO_FAULTS UINT32_MAX
+
+struct __attribute__((packed)) flight_plugin_rec {
+	uint64_t time_ns; // when the request was sent
+	uint32_t seq;
+	uint32_t rate;
+	uint8_t bps;
+	uint8_t ch;
+	uint8_t is_float;
+	uint8_t pad;
+	int32_t frames_in;
+	int32_t frames_out; // -1 = failed
+	uint32_t duration_us; // until the response was read
+	uint32_t minflt; // page faults of the calling thread in that time
+	uint32_t majflt;
+};
+
+struct __attribute__((packed)) flight_host_rec {
+	uint64_t time_ns; // when the request was read
+	uint32_t seq;
+	uint32_t rate;
+	uint8_t bps;
+	uint8_t ch;
+	uint8_t nplugins;
+	uint8_t pad;
+	uint32_t bytes_in;
+	uint32_t bytes_out;
+	uint32_t carry_bytes; // left in the plugins' temp. buffers afterwards
+	uint32_t faults; // page faults of the whole process, soft and hard
+	struct __attribute__((packed)) flight_host_plugin {
+		int32_t frames_in;
+		int32_t frames_out;
+		uint32_t duration_us;
+		uint32_t copy_bytes; // memcpy'd around it, including format adapters
+	} plugins[FLIGHT_MAX_PLUGINS];
+};
+
+struct __attribute__((packed)) flightdata {
+	char magic[8];
+
+	// number of records written so far by each side
+	// record n is at index n%FLIGHT_RECORDS
+	uint32_t plugin_seq;
+	uint32_t host_seq;
+
+	uint32_t host_starts;
+
+	struct flight_plugin_rec plugin[FLIGHT_RECORDS];
+	struct flight_host_rec host[FLIGHT_RECORDS];
+};
+
+// -----------------------------------------------------------------------------
+
+static inline void
+__attribute__((unused))
+flight_print_plugin_rec(FILE *f, const struct flight_plugin_rec *r)
+{
+	fprintf(f, "plugin #%" PRIu32 " t=%" PRIu64 " rate=%" PRIu32 " bps=%u%s ch=%u frames=%" PRId32 "->%" PRId32 " %" PRIu32 "us faults=%" PRIu32 "/%" PRIu32 "\n",
+	    r->seq, r->time_ns,
+	    r->rate, r->bps, r->is_float ? "f" : "", r->ch,
+	    r->frames_in, r->frames_out,
+	    r->duration_us,
+	    r->minflt, r->majflt);
+}
+
+static inline void
+__attribute__((unused))
+flight_print_host_rec(FILE *f, const struct flight_host_rec *r)
+{
+	fprintf(f, "host #%" PRIu32 " t=%" PRIu64 " rate=%" PRIu32 " bps=%u ch=%u bytes=%" PRIu32 "->%" PRIu32 " carry=%" PRIu32,
+	    r->seq, r->time_ns,
+	    r->rate, r->bps, r->ch,
+	    r->bytes_in, r->bytes_out,
+	    r->carry_bytes);
+	if (r->faults != FLIGHT_NO_FAULTS)
+		fprintf(f, " faults=%" PRIu32, r->faults);
+	fprintf(f, "\n");
+
+	for (unsigned int i = 0; i < r->nplugins && i < FLIGHT_MAX_PLUGINS; i++) {
+		fprintf(f, "  [%u] frames=%" PRId32 "->%" PRId32 " %" PRIu32 "us copied=%" PRIu32 "\n",
+		    i,
+		    r->plugins[i].frames_in, r->plugins[i].frames_out,
+		    r->plugins[i].duration_us,
+		    r->plugins[i].copy_bytes);
+	}
+}
+
+//
+// print the records of both sides, oldest first
+//
+static inline void
+__attribute__((unused))
+flight_print(FILE *f, const struct flightdata *fd)
+{
+	uint32_t n;
+
+	fprintf(f, "# host starts: %" PRIu32 "\n", fd->host_starts);
+
+	n = fd->plugin_seq;
+	fprintf(f, "# plugin: %" PRIu32 " blocks\n", n);
+	for (uint32_t i = (n > FLIGHT_RECORDS) ? n-FLIGHT_RECORDS : 0; i < n; i++)
+		flight_print_plugin_rec(f, &fd->plugin[i % FLIGHT_RECORDS]);
+
+	n = fd->host_seq;
+	fprintf(f, "# host: %" PRIu32 " blocks\n", n);
+	for (uint32_t i = (n > FLIGHT_RECORDS) ? n-FLIGHT_RECORDS : 0; i < n; i++)
+		flight_print_host_rec(f, &fd->host[i % FLIGHT_RECORDS]);
+}
@@ -0,0 +1,76 @@
+#include "child.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../shm/shmdata.h"
+
+//
+// the hosts report how much audio they're holding on to after every block.
+//  the total over all dsp instances goes to ddb_shm's shared memory, which
+//  takes it off the playback position it publishes (and that winamp plugins
+//  get from IPC_GETOUTPUTTIME)
+//
+
+static int total_ms;
+
+// NULL = not tried yet, MAP_FAILED = not available
+static struct shmdata *shm;
+
+// -----------------------------------------------------------------------------
+
+static struct shmdata *
+shm_get(void)
+{
+	const char *name;
+	void *p;
+	int fildes;
+
+	if (shm != NULL)
+		return (shm != MAP_FAILED) ? shm : NULL;
+
+	// (not set yet if ddb_shm hasn't connected, try again next time)
+	name = getenv("DDW_SHM_NAME");
+	if (name == NULL)
+		return NULL;
+
+	fildes = open(name, O_RDWR|O_CLOEXEC);
+	if (fildes == -1) {
+		perror("dsp_winamp: latency: open");
+		shm = MAP_FAILED;
+		return NULL;
+	}
+
+	p = mmap(NULL, sizeof(struct shmdata), PROT_READ|PROT_WRITE, MAP_SHARED, fildes, 0);
+	if (p == MAP_FAILED)
+		perror("dsp_winamp: latency: mmap");
+	close(fildes);
+
+	shm = p;
+
+	return (shm != MAP_FAILED) ? shm : NULL;
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// set the latency of this instance. 0 when the host is stopped
+//
+void
+latency_set(struct child *self, int ms)
+{
+	struct shmdata *p;
+	int total;
+
+	if (ms == self->latency_ms)
+		return;
+
+	total = __atomic_add_fetch(&total_ms, ms-self->latency_ms, __ATOMIC_RELAXED);
+	self->latency_ms = ms;
+
+	p = shm_get();
+	if (p != NULL)
+		p->dsp_latency_ms = total;
+}
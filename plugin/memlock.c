@@ -0,0 +1,134 @@
+#include "child.h"
+
+#include <alloca.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "plugin.h"
+
+//
+// ddw.lock_memory keeps the audio path from page faulting: the fifo, the
+//  held input, the conversion buffer and the flight recorder are prefaulted
+//  and mlock'd as they're sized, and so is a part of the streamer thread's
+//  stack for the alloca()s in chldproc.c. the host does the same on its
+//  side (DDW_LOCK_MEMORY, host/memlock.h)
+//
+// mlock() can only lock up to RLIMIT_MEMLOCK, which is 8 MB by default on
+//  newer kernels and 64 KB on older ones
+//
+
+#define MEMLOCK_PAGE 4096
+
+// how much of the streamer thread's stack to prefault
+#define MEMLOCK_STACK (1024*1024)
+
+// how much of it to leave alone at the end, for whatever runs deeper
+#define MEMLOCK_STACK_SPARE (256*1024)
+
+// -----------------------------------------------------------------------------
+
+static bool
+enabled(void)
+{
+	return deadbeef->conf_get_int("ddw.lock_memory", 0) != 0;
+}
+
+static void
+lock(void *p, size_t sz)
+{
+	static bool failed = false;
+
+	if (mlock(p, sz) == -1 && !__atomic_exchange_n(&failed, true, __ATOMIC_RELAXED)) {
+		fprintf(stderr, "dsp_winamp: mlock: %s%s\n",
+		    strerror(errno),
+		    (errno == ENOMEM || errno == EPERM) ? " (is RLIMIT_MEMLOCK too low?)" : "");
+	}
+}
+
+//
+// touch every page of p and lock it, if ddw.lock_memory is set
+//
+void
+memlock_region(void *p, size_t sz)
+{
+	volatile char *q = p;
+
+	if (p == NULL || sz == 0 || !enabled())
+		return;
+
+	// writes, so pages that were never touched get their own copy instead
+	//  of the shared zero page
+	for (size_t i = 0; i < sz; i += MEMLOCK_PAGE)
+		q[i] = q[i];
+	q[sz-1] = q[sz-1];
+
+	lock(p, sz);
+}
+
+//
+// undo memlock_region() for a block that's about to be freed or realloc()'d.
+//  only the pages that are all inside it, the ones at the ends may have
+//  another block on them that's still locked
+//
+void
+memlock_unlock(void *p, size_t sz)
+{
+	uintptr_t start, end;
+
+	if (p == NULL || sz == 0 || !enabled())
+		return;
+
+	start = ((uintptr_t)p+MEMLOCK_PAGE-1) & ~(uintptr_t)(MEMLOCK_PAGE-1);
+	end = ((uintptr_t)p+sz) & ~(uintptr_t)(MEMLOCK_PAGE-1);
+
+	if (end > start)
+		munlock((void *)start, end-start);
+}
+
+//
+// prefault and lock the calling thread's stack below here, once per thread.
+//  only as much as it has to spare
+//
+void
+memlock_streamer(void)
+{
+	static __thread bool done = false;
+	pthread_attr_t attr;
+	void *stackaddr;
+	size_t stacksz;
+	char *here = __builtin_frame_address(0);
+	size_t left, sz;
+	volatile char *p;
+
+	if (done)
+		return;
+	done = true;
+
+	if (!enabled())
+		return;
+
+	if (pthread_getattr_np(pthread_self(), &attr) != 0)
+		return;
+	if (pthread_attr_getstack(&attr, &stackaddr, &stacksz) != 0) {
+		pthread_attr_destroy(&attr);
+		return;
+	}
+	pthread_attr_destroy(&attr);
+
+	// (grows down on everything deadbeef runs on)
+	left = here-(char *)stackaddr;
+	if (left <= MEMLOCK_STACK_SPARE)
+		return;
+	sz = left-MEMLOCK_STACK_SPARE;
+	if (sz > MEMLOCK_STACK)
+		sz = MEMLOCK_STACK;
+
+	p = alloca(sz);
+	for (size_t i = 0; i < sz; i += MEMLOCK_PAGE)
+		p[i] = 0;
+	p[sz-1] = 0;
+
+	lock((void *)p, sz);
+}
@@ -3,8 +3,13 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "ddw.h"
+
 /* check if the values in a processing_request make sense */
 #define PRREQ_IS_VALID(req) ( \
+	((req).command == DDW_CMD_RESET || (req).command == DDW_CMD_FLUSH) ? \
+	(req).buffer_size == 0 : \
+	((req).command == DDW_CMD_PROCESS || (req).command == DDW_CMD_SILENCE) && \
 	(req).bitspersample != 0 && \
 	(req).bitspersample % 8 == 0 && \
 	(req).channels != 0 && \
@@ -18,8 +23,15 @@ __attribute__((unused))
 __attribute__((warn_unused_result))
 read_full(int fd, void *data, size_t size)
 {
-	ssize_t result = read(fd, data, size);
-	return result >= 0 && (size_t)result == size;
+	// (a pipe gives back at most its buffer size at a time)
+	while (size > 0) {
+		ssize_t result = read(fd, data, size);
+		if (result <= 0)
+			return false;
+		data = (char *)data+result;
+		size -= (size_t)result;
+	}
+	return true;
 }
 
 static inline bool
@@ -118,7 +118,11 @@ dsp_winamp_close(ddb_dsp_context_t *ctx)
 {
 	struct ddw *plugin = (struct ddw *)ctx;
 
+	cache_close(&plugin->host);
 	child_stop(&plugin->host);
+	flight_close(&plugin->host);
+	capture_close(&plugin->host);
+	child_free_buffers(&plugin->host);
 
 	free(plugin->dll);
 	free(plugin);
@@ -149,7 +153,10 @@ dsp_winamp_process(ddb_dsp_context_t *ctx,
 	if (convinfo&NEED_FLOAT)
 		nextfmt.is_float = 1;
 
-	frames = child_process_samples(&plugin->host,
+	sched_pin_streamer();
+	memlock_streamer();
+
+	frames = cache_process(&plugin->host,
 	    fmt, &nextfmt,
 	    (char *)samples, frames,
 	    outcap);
@@ -178,12 +185,24 @@ dsp_winamp_process(ddb_dsp_context_t *ctx,
 }
 
 //
-// called when playback is stopped or un-stopped
+// called when playback is stopped or un-stopped, and on seeks. the audio
+//  buffered in the host is from before, throw it out. with ddw.flush_ms the
+//  dlls get that much silence first so they don't play their old tail
 //
 static void
 dsp_winamp_reset(ddb_dsp_context_t *ctx)
 {
+	struct ddw *plugin = (struct ddw *)ctx;
+	int flush_ms;
+
 	have_patch1 = deadbeef->conf_get_int("ddw.patch1", 0);
+	flush_ms = deadbeef->conf_get_int("ddw.flush_ms", 0);
+
+	cache_reset(&plugin->host);
+
+	child_send_command(&plugin->host,
+	    (flush_ms > 0) ? DDW_CMD_FLUSH : DDW_CMD_RESET,
+	    (flush_ms > 0) ? flush_ms : 0);
 }
 
 #define NUM_PARAMS 2
@@ -236,6 +255,7 @@ dsp_winamp_set_param(ddb_dsp_context_t *ctx, int p, const char *val)
 
 		child_stop(&plugin->host);
 		child_reset_failures(&plugin->host);
+		child_drop_buffered(&plugin->host);
 
 		free(plugin->dll);
 		plugin->dll = newdll;
@@ -289,8 +309,9 @@ dsp_winamp_can_bypass(ddb_dsp_context_t *ctx, ddb_waveformat_t *fmt)
 	struct ddw *plugin = (struct ddw *)ctx;
 	int convinfo;
 
-	// have some processing to do?
-	if (ddw_has_dll(plugin))
+	// have some processing to do? (not if none of the dlls can run at
+	//  this format)
+	if (ddw_has_dll(plugin) && !child_is_inactive(&plugin->host, fmt))
 		return false;
 
 	// need to convert for the next dsp?
@@ -321,7 +342,17 @@ static DB_dsp_t plugindef = {
 		"property \"Max. bit depth\" entry 1 \"\";\n",
 	.plugin.configdialog =
 		"property \"Host command\" entry ddw.host_cmd \"ddw_host.exe\";\n"
-		"property \"DSP plugin can return non-32bit samples\" checkbox ddw.patch1 0;\n",
+		"property \"DSP plugin can return non-32bit samples\" checkbox ddw.patch1 0;\n"
+		"property \"Capture requests to directory (for ddw_replay)\" entry ddw.capture_dir \"\";\n"
+		"property \"Silence to flush plugins with on seek/stop (ms)\" entry ddw.flush_ms 0;\n"
+		"property \"Cache processed tracks in directory\" entry ddw.cache_dir \"\";\n"
+		"property \"Host thread priority (normal, high, critical, mmcss)\" entry ddw.host_priority \"\";\n"
+		"property \"Host thread SCHED_FIFO priority (0 = off)\" entry ddw.host_rtprio 0;\n"
+		"property \"Host CPUs (e.g. 2,3)\" entry ddw.host_cpus \"\";\n"
+		"property \"Host processing thread CPUs\" entry ddw.host_thread_cpus \"\";\n"
+		"property \"Streamer thread CPUs\" entry ddw.streamer_cpus \"\";\n"
+		"property \"Prefault and lock audio buffers\" checkbox ddw.lock_memory 0;\n"
+		"property \"Count page faults in the host's flight recorder\" checkbox ddw.count_faults 0;\n",
 	.can_bypass = dsp_winamp_can_bypass,
 };
 
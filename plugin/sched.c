@@ -0,0 +1,179 @@
+#include "child.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plugin.h"
+
+//
+// scheduling on the linux side. the host's own settings (ddw.host_priority
+//  etc.) are passed to it in the environment by child_start(), see
+//  host/sched.h
+//
+// ddw.host_rtprio=N makes the host's processing thread SCHED_FIFO at
+//  priority N. it's found by its name, which the host sets. needs
+//  RLIMIT_RTPRIO (e.g. from limits.conf), there's no rtkit support
+//
+// ddw.streamer_cpus pins deadbeef's streamer thread (the one that calls
+//  process()), to keep it off the host's cpus
+//
+
+#define HOST_THREAD_NAME "ddw_process"
+
+// -----------------------------------------------------------------------------
+
+//
+// "0,2-3" -> {0, 2, 3}. false if it's malformed or empty
+//
+static bool
+parse_cpus(const char *s, cpu_set_t *out)
+{
+	CPU_ZERO(out);
+
+	while (*s != '\0') {
+		char *end;
+		long lo, hi;
+
+		lo = hi = strtol(s, &end, 10);
+		if (end == s)
+			return false;
+		s = end;
+
+		if (*s == '-') {
+			s++;
+			hi = strtol(s, &end, 10);
+			if (end == s)
+				return false;
+			s = end;
+		}
+		if (lo < 0 || hi >= CPU_SETSIZE || lo > hi)
+			return false;
+
+		for (long i = lo; i <= hi; i++)
+			CPU_SET(i, out);
+
+		if (*s == ',')
+			s++;
+		else if (*s != '\0')
+			return false;
+	}
+
+	return CPU_COUNT(out) != 0;
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// look for the host's processing threads by name and make them SCHED_FIFO.
+//  returns false if there aren't any (yet)
+//
+static bool
+boost_thread(pid_t pid, int prio)
+{
+	struct sched_param sp = {.sched_priority = prio};
+	char path[64];
+	bool found = false;
+	struct dirent *ent;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+	dir = opendir(path);
+	if (dir == NULL)
+		return false;
+
+	while ((ent = readdir(dir)) != NULL) {
+		char comm[32] = {0};
+		FILE *f;
+		pid_t tid = atoi(ent->d_name);
+
+		if (tid <= 0)
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%d/task/%d/comm", (int)pid, (int)tid);
+		f = fopen(path, "re");
+		if (f == NULL)
+			continue;
+		if (fgets(comm, sizeof(comm), f) == NULL)
+			comm[0] = '\0';
+		fclose(f);
+
+		comm[strcspn(comm, "\n")] = '\0';
+		if (strcmp(comm, HOST_THREAD_NAME) != 0)
+			continue;
+
+		found = true;
+
+		// (not for threads the dlls might start from it)
+		if (sched_setscheduler(tid, SCHED_FIFO|SCHED_RESET_ON_FORK, &sp) == -1) {
+			fprintf(stderr, "dsp_winamp: couldn't make the host's thread SCHED_FIFO: %s%s\n",
+			    strerror(errno),
+			    (errno == EPERM) ? " (is RLIMIT_RTPRIO set?)" : "");
+			break;
+		}
+
+		// (no break, split= gives a dll more threads with the name)
+	}
+	closedir(dir);
+
+	return found;
+}
+
+//
+// called after every block until it has happened once for this host. the
+//  thread is only sure to exist (and have its name) once the host has
+//  answered
+//
+void
+sched_host_started(struct child *self)
+{
+	int prio;
+
+	if (self->sched_done)
+		return;
+	self->sched_done = true;
+
+	prio = deadbeef->conf_get_int("ddw.host_rtprio", 0);
+	if (prio <= 0)
+		return;
+
+	if (prio < sched_get_priority_min(SCHED_FIFO) || prio > sched_get_priority_max(SCHED_FIFO)) {
+		fprintf(stderr, "dsp_winamp: ddw.host_rtprio %d is out of range\n", prio);
+		return;
+	}
+
+	if (!boost_thread(self->pid, prio))
+		fprintf(stderr, "dsp_winamp: didn't find the host's " HOST_THREAD_NAME " thread, can't set its priority\n");
+}
+
+//
+// pin the calling thread to ddw.streamer_cpus, once per thread
+//
+void
+sched_pin_streamer(void)
+{
+	static __thread bool done = false;
+	cpu_set_t set;
+	char cpus[128];
+
+	if (done)
+		return;
+	done = true;
+
+	deadbeef->conf_lock();
+	snprintf(cpus, sizeof(cpus), "%s", deadbeef->conf_get_str_fast("ddw.streamer_cpus", ""));
+	deadbeef->conf_unlock();
+
+	if (cpus[0] == '\0')
+		return;
+
+	if (!parse_cpus(cpus, &set)) {
+		fprintf(stderr, "dsp_winamp: couldn't parse ddw.streamer_cpus \"%s\"\n", cpus);
+		return;
+	}
+
+	if (sched_setaffinity(0, sizeof(set), &set) == -1)
+		perror("dsp_winamp: sched_setaffinity");
+}
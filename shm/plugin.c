@@ -14,6 +14,36 @@ static char shmname[64];
 
 // -----------------------------------------------------------------------------
 
+//
+// winamp plugins expect a windows path. local files are visible under Z: in
+//  wine so convert those, leave anything else (urls) as-is
+//
+static void
+set_track_filename(const char *uri)
+{
+	if (uri[0] != '/') {
+		snprintf(shm->track_filename, sizeof(shm->track_filename), "%s", uri);
+		return;
+	}
+
+	snprintf(shm->track_filename, sizeof(shm->track_filename), "Z:%s", uri);
+	for (char *p = shm->track_filename; *p != '\0'; p++) {
+		if (*p == '/')
+			*p = '\\';
+	}
+}
+
+static void
+update_volume(void)
+{
+	float amp = deadbeef->volume_get_amp();
+
+	if (amp < 0.0f) amp = 0.0f;
+	if (amp > 1.0f) amp = 1.0f;
+
+	shm->volume = (int)(amp*VOLUME_MAX + 0.5f);
+}
+
 static int
 shm_message(uint32_t id, uintptr_t ctx, uint32_t p1, uint32_t p2) {
 	switch (id) {
@@ -32,6 +62,12 @@ shm_message(uint32_t id, uintptr_t ctx, uint32_t p1, uint32_t p2) {
 
 			if (plt)
 				shm->track_idx = deadbeef->plt_get_item_idx(plt, it, PL_MAIN);
+
+			shm->samplerate = deadbeef->pl_find_meta_int(it, ":SAMPLERATE", 0);
+			shm->channels = deadbeef->pl_find_meta_int(it, ":CHANNELS", 0);
+			shm->bitrate = deadbeef->pl_find_meta_int(it, ":BITRATE", 0);
+
+			set_track_filename(deadbeef->pl_find_meta(it, ":URI") ?: "");
 		}
 		if (it)
 			deadbeef->pl_item_unref(it);
@@ -53,6 +89,9 @@ shm_message(uint32_t id, uintptr_t ctx, uint32_t p1, uint32_t p2) {
 			tickthread_start_ticking();
 		}
 		break;
+	case DB_EV_VOLUMECHANGED:
+		update_volume();
+		break;
 	}
 
 	return 0;
@@ -70,6 +109,8 @@ shm_connect(void)
 	if (shm == NULL)
 		goto err;
 
+	update_volume();
+
 	setenv("DDW_SHM_NAME", shmname, 1);
 
 	if (!tickthread_init())
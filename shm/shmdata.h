@@ -14,4 +14,16 @@ struct __attribute__((packed)) shmdata {
 #define ISPLAYING_PAUSED 3
 #define ISPLAYING_NOTPLAYING 2
 	int32_t isplaying;
+
+	int32_t samplerate; // Hz
+	int32_t bitrate; // kbps, updated while playing
+	int32_t channels;
+	char track_filename[512]; // windows path (Z:\...) if it's a local file
+
+#define VOLUME_MAX 255
+	int32_t volume; // 0-VOLUME_MAX
+
+	// audio held back in dsp_winamp's hosts, written by the dsp plugin.
+	//  playback_pos_ms has it taken off already
+	int32_t dsp_latency_ms;
 };
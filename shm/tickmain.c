@@ -2,26 +2,166 @@
 
 #include <errno.h>
 #include <pthread.h>
-#include <sys/event.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "plugin.h"
 
-#define IDENT_TICK 123
-#define IDENT_DIENOW 666
+//
+// two backends for the timer thread:
+// - timerfd+eventfd+epoll: native on linux, used by default there
+// - kqueue: native on the BSDs. on linux it's only available through
+//    libkqueue, which emulates it with a helper thread of its own (build
+//    with KQUEUE=1 to use it anyway, e.g. for comparing the two)
+//
+#if !defined(TICK_KQUEUE) && !defined(TICK_TIMERFD)
+ #if defined(__linux__)
+  #define TICK_TIMERFD
+ #else
+  #define TICK_KQUEUE
+ #endif
+#endif
 
-#if !defined(NOTE_MSECONDS)
- #define NOTE_MSECONDS 0
+#if defined(TICK_KQUEUE)
+ #include <sys/event.h>
+#else
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/timerfd.h>
 #endif
 
-static int kq = -1;
+#define TICK_INTERVAL_MS 100
+
 static pthread_t tickthread;
 
 // -----------------------------------------------------------------------------
 
 static void
-update_tick(void);
+update_tick(void)
+{
+	int pos_ms = (int)(1000.0f*deadbeef->streamer_get_playpos());
+
+	// what's still in the dsps hasn't been heard yet
+	pos_ms -= shm->dsp_latency_ms;
+	shm->playback_pos_ms = (pos_ms > 0) ? pos_ms : 0;
+
+	// vbr files report their bitrate as they go
+	int bitrate = deadbeef->streamer_get_apx_bitrate();
+	if (bitrate > 0)
+		shm->bitrate = bitrate;
+}
+
+//
+// wakeup cost and jitter measurement (build with TICKSTATS=1)
+// everything here except start_gen is only touched by the tick thread
+//
+#if defined(TICKSTATS)
+
+#define TICKSTATS_REPORT_EVERY 100
+
+// bumped by tickthread_start_ticking() so the tick thread knows to take a
+//  new reference point
+static _Atomic unsigned int start_gen;
+
+static struct tickstats {
+	unsigned int gen;
+	uint64_t next_ns; // when the next tick is due, 0 = no reference point
+	uint64_t ticks;
+	uint64_t missed;
+	uint64_t late_sum_ns;
+	uint64_t late_max_ns;
+	uint64_t cpu_sum_ns;
+} stats;
+
+static uint64_t
+clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void
+tickstats_report(const char *why)
+{
+	if (stats.ticks == 0)
+		return;
+
+	fprintf(stderr, "ddb_shm: %s: %llu ticks (%llu missed), late avg %.1f us max %.1f us, cpu %.1f us/tick\n",
+	    why,
+	    (unsigned long long)stats.ticks,
+	    (unsigned long long)stats.missed,
+	    (double)stats.late_sum_ns/stats.ticks/1000.0,
+	    (double)stats.late_max_ns/1000.0,
+	    (double)stats.cpu_sum_ns/stats.ticks/1000.0);
+
+	stats = (struct tickstats){.gen = stats.gen, .next_ns = stats.next_ns};
+}
+
+//
+// expirations: how many timer periods have passed since the last wakeup
+//  (more than 1 means we slept through some)
+//
+static void
+tickstats_wakeup(uint64_t expirations, uint64_t cpu_start_ns)
+{
+	uint64_t now = clock_ns(CLOCK_MONOTONIC);
+	uint64_t late;
+
+	if (stats.gen != start_gen) {
+		stats.gen = start_gen;
+		stats.next_ns = 0;
+	}
+
+	if (stats.next_ns == 0) {
+		// first tick since starting, no reference point yet
+		stats.next_ns = now+(uint64_t)TICK_INTERVAL_MS*1000000;
+		return;
+	}
+
+	stats.next_ns += (expirations-1)*(uint64_t)TICK_INTERVAL_MS*1000000;
+	late = (now > stats.next_ns) ? now-stats.next_ns : 0;
+	stats.next_ns += (uint64_t)TICK_INTERVAL_MS*1000000;
+
+	stats.ticks += 1;
+	stats.missed += expirations-1;
+	stats.late_sum_ns += late;
+	if (late > stats.late_max_ns)
+		stats.late_max_ns = late;
+	stats.cpu_sum_ns += clock_ns(CLOCK_THREAD_CPUTIME_ID)-cpu_start_ns;
+
+	if (stats.ticks == TICKSTATS_REPORT_EVERY)
+		tickstats_report("tick stats");
+}
+
+#define TICKSTATS_CPU_START() uint64_t cpu_start_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID)
+#define TICKSTATS_WAKEUP(exp) tickstats_wakeup((exp), cpu_start_ns)
+#define TICKSTATS_STOPPED() tickstats_report("tick stats")
+#define TICKSTATS_STARTED() (start_gen += 1)
+
+#else
+
+#define TICKSTATS_CPU_START() do {} while (0)
+#define TICKSTATS_WAKEUP(exp) do {} while (0)
+#define TICKSTATS_STOPPED() do {} while (0)
+#define TICKSTATS_STARTED() do {} while (0)
+
+#endif
+
+// -----------------------------------------------------------------------------
+
+#if defined(TICK_KQUEUE)
+
+#define IDENT_TICK 123
+#define IDENT_DIENOW 666
+
+#if !defined(NOTE_MSECONDS)
+ #define NOTE_MSECONDS 0
+#endif
+
+static int kq = -1;
 
 static void *
 tickthread_main(void *ud)
@@ -31,8 +171,9 @@ tickthread_main(void *ud)
 	for (;;) {
 		struct kevent ev = {0};
 		int rv = kevent(kq, NULL, 0, &ev, 1, NULL);
+		TICKSTATS_CPU_START();
 		if (rv == -1) {
-			if (rv == EINTR) continue;
+			if (errno == EINTR) continue;
 			perror("ddb_shm: kevent");
 			break;
 		}
@@ -40,6 +181,7 @@ tickthread_main(void *ud)
 
 		if (ev.filter == EVFILT_TIMER && ev.ident == IDENT_TICK) {
 			update_tick();
+			TICKSTATS_WAKEUP((uint64_t)ev.data ?: 1);
 			continue;
 		}
 		if (ev.filter == EVFILT_USER && ev.ident == IDENT_DIENOW) {
@@ -47,17 +189,10 @@ tickthread_main(void *ud)
 		}
 	}
 out:
+	TICKSTATS_STOPPED();
 	return NULL;
 }
 
-static void
-update_tick(void)
-{
-	shm->playback_pos_ms = (int)(1000.0f*deadbeef->streamer_get_playpos());
-}
-
-// -----------------------------------------------------------------------------
-
 void
 tickthread_start_ticking(void)
 {
@@ -66,9 +201,10 @@ tickthread_start_ticking(void)
 		.filter = EVFILT_TIMER,
 		.flags = EV_ADD,
 		.fflags = NOTE_MSECONDS,
-		.data = 100,
+		.data = TICK_INTERVAL_MS,
 	};
 
+	TICKSTATS_STARTED();
 	kevent(kq, &ev, 1, NULL, 0, NULL);
 }
 
@@ -84,6 +220,193 @@ tickthread_stop_ticking(void)
 	kevent(kq, &ev, 1, NULL, 0, NULL);
 }
 
+static bool
+backend_init(void)
+{
+	kq = kqueue();
+	if (kq == -1) {
+		perror("ddb_shm: kqueue");
+		return false;
+	}
+
+	return true;
+}
+
+static void
+backend_tell_exit(void)
+{
+	//
+	// (is there no way to do this in one call?)
+	//
+	struct kevent ev = {
+		.ident = IDENT_DIENOW,
+		.filter = EVFILT_USER,
+		.flags = EV_ADD|EV_CLEAR,
+	};
+	struct kevent ev2 = {
+		.ident = IDENT_DIENOW,
+		.filter = EVFILT_USER,
+		.fflags = NOTE_TRIGGER,
+	};
+
+	if (kq == -1)
+		return;
+
+	if (-1 == kevent(kq, &ev, 1, NULL, 0, NULL))
+		perror("ddb_shm: kevent");
+	if (-1 == kevent(kq, &ev2, 1, NULL, 0, NULL))
+		perror("ddb_shm: kevent");
+}
+
+static void
+backend_deinit(void)
+{
+	if (kq != -1) {
+		close(kq);
+		kq = -1;
+	}
+}
+
+#else // TICK_TIMERFD
+
+static int epfd = -1;
+static int tfd = -1; // timerfd, readable when a tick is due
+static int efd = -1; // eventfd, readable when the thread should exit
+
+static void
+backend_deinit(void);
+
+static void *
+tickthread_main(void *ud)
+{
+	(void)ud;
+
+	for (;;) {
+		struct epoll_event ev = {0};
+		uint64_t cnt;
+		int rv = epoll_wait(epfd, &ev, 1, -1);
+		TICKSTATS_CPU_START();
+		if (rv == -1) {
+			if (errno == EINTR) continue;
+			perror("ddb_shm: epoll_wait");
+			break;
+		}
+		if (rv == 0) continue;
+
+		if (ev.data.fd == tfd) {
+			// fails with EAGAIN if the timer was disarmed in between
+			if (read(tfd, &cnt, sizeof(cnt)) != sizeof(cnt))
+				continue;
+			update_tick();
+			TICKSTATS_WAKEUP(cnt);
+			continue;
+		}
+		if (ev.data.fd == efd) {
+			goto out;
+		}
+	}
+out:
+	TICKSTATS_STOPPED();
+	return NULL;
+}
+
+static void
+set_timer(long ms)
+{
+	struct itimerspec its = {
+		.it_interval = {.tv_sec = ms/1000, .tv_nsec = (ms%1000)*1000000},
+		.it_value = {.tv_sec = ms/1000, .tv_nsec = (ms%1000)*1000000},
+	};
+
+	if (-1 == timerfd_settime(tfd, 0, &its, NULL))
+		perror("ddb_shm: timerfd_settime");
+}
+
+void
+tickthread_start_ticking(void)
+{
+	TICKSTATS_STARTED();
+	set_timer(TICK_INTERVAL_MS);
+}
+
+void
+tickthread_stop_ticking(void)
+{
+	// all zeroes = disarm
+	set_timer(0);
+}
+
+static bool
+backend_init(void)
+{
+	struct epoll_event ev;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1) {
+		perror("ddb_shm: epoll_create1");
+		goto err;
+	}
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+	if (tfd == -1) {
+		perror("ddb_shm: timerfd_create");
+		goto err;
+	}
+
+	efd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (efd == -1) {
+		perror("ddb_shm: eventfd");
+		goto err;
+	}
+
+	ev = (struct epoll_event){.events = EPOLLIN, .data.fd = tfd};
+	if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev)) {
+		perror("ddb_shm: epoll_ctl");
+		goto err;
+	}
+
+	ev = (struct epoll_event){.events = EPOLLIN, .data.fd = efd};
+	if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev)) {
+		perror("ddb_shm: epoll_ctl");
+		goto err;
+	}
+
+	return true;
+err:
+	backend_deinit();
+
+	return false;
+}
+
+static void
+backend_tell_exit(void)
+{
+	if (efd == -1)
+		return;
+
+	if (-1 == eventfd_write(efd, 1))
+		perror("ddb_shm: eventfd_write");
+}
+
+static void
+backend_deinit(void)
+{
+	if (epfd != -1) {
+		close(epfd);
+		epfd = -1;
+	}
+	if (tfd != -1) {
+		close(tfd);
+		tfd = -1;
+	}
+	if (efd != -1) {
+		close(efd);
+		efd = -1;
+	}
+}
+
+#endif
+
 // -----------------------------------------------------------------------------
 
 bool
@@ -92,25 +415,19 @@ tickthread_init(void)
 	if (tickthread != 0)
 		return false;
 
-	kq = kqueue();
-	if (kq == -1) {
-		perror("ddb_shm: kqueue");
+	if (!backend_init())
 		goto err;
-	}
 
 	int err = pthread_create(&tickthread, NULL, tickthread_main, NULL);
 	if (err != 0) {
 		tickthread = 0;
-		fprintf(stderr, "ddb_shm: pthread_create: %s\n", strerror(errno));
+		fprintf(stderr, "ddb_shm: pthread_create: %s\n", strerror(err));
 		goto err;
 	}
 
 	return true;
 err:
-	if (kq != -1) {
-		close(kq);
-		kq = -1;
-	}
+	backend_deinit();
 
 	return false;
 }
@@ -122,28 +439,8 @@ tickthread_deinit(void)
 		return;
 
 	// tell tickthread to exit
-	if (kq != -1) {
-		if (tickthread != 0)
-			tickthread_stop_ticking();
-
-		//
-		// (is there no way to do this in one call?)
-		//
-		struct kevent ev = {
-			.ident = IDENT_DIENOW,
-			.filter = EVFILT_USER,
-			.flags = EV_ADD|EV_CLEAR,
-		};
-		struct kevent ev2 = {
-			.ident = IDENT_DIENOW,
-			.filter = EVFILT_USER,
-			.fflags = NOTE_TRIGGER,
-		};
-		if (-1 == kevent(kq, &ev, 1, NULL, 0, NULL))
-			perror("ddb_shm: kevent");
-		if (-1 == kevent(kq, &ev2, 1, NULL, 0, NULL))
-			perror("ddb_shm: kevent");
-	}
+	tickthread_stop_ticking();
+	backend_tell_exit();
 
 	// try-join tickthread
 	if (tickthread != 0) {
@@ -158,11 +455,7 @@ tickthread_deinit(void)
 		}
 	}
 
-	// close the kqueue if the thread was joined successfully
-	if (tickthread == 0) {
-		if (kq != -1) {
-			close(kq);
-			kq = -1;
-		}
-	}
+	// close the fds if the thread was joined successfully
+	if (tickthread == 0)
+		backend_deinit();
 }
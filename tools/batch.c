@@ -0,0 +1,372 @@
+//
+// ddw_batch: renders files with a pool of ddw_host.exe --render-batch
+//  processes running the same chain
+//
+// winamp dsps have state, so one file can't be split between hosts, but
+//  different files can go to different hosts. every host is started once
+//  and gets the next file from the queue whenever it finishes one (the host
+//  restarts the dsps in between). results are printed in the order the
+//  files were given
+//
+// the chain is given like the plugin's dll setting, and goes through sh
+//  with the host command
+//
+// paths are made absolute and given to the host with the prefix from -P
+//  (default "Z:", wine's default drive for /). every output goes to outdir
+//  under the input's file name, so the inputs' file names have to differ
+//
+// usage: ddw_batch [-j hosts] [-H host_cmd] [-f rate,bits,ch] [-P prefix]
+//                  -o outdir chain file...
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+enum job_state {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_OK,
+	JOB_FAILED,
+};
+
+struct job {
+	const char *in;
+	char *in_abs;
+	char *out_abs;
+	enum job_state state;
+	uint64_t ns;
+};
+
+struct worker {
+	pid_t pid;
+	int to;
+	FILE *from;
+	int job; // -1 = idle
+	uint64_t start_ns;
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// -----------------------------------------------------------------------------
+
+static bool
+worker_start(struct worker *self, const char *cmd)
+{
+	int to[2] = {-1, -1},
+	    from[2] = {-1, -1}; // {read_end, write_end}
+	pid_t pid;
+
+	// (cloexec so the other hosts don't inherit them, dup2() clears it)
+	if (pipe2(to, O_CLOEXEC) < 0 || pipe2(from, O_CLOEXEC) < 0) {
+		perror("ddw_batch: pipe");
+		goto failed;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("ddw_batch: fork");
+failed:
+		close(to[0]);
+		close(to[1]);
+		close(from[0]);
+		close(from[1]);
+		return false;
+	} else if (pid == 0) {
+		if (dup2(to[0], STDIN_FILENO) < 0 ||
+		    dup2(from[1], STDOUT_FILENO) < 0) {
+			perror("ddw_batch: dup2");
+			_exit(EXIT_FAILURE);
+		}
+		execl("/bin/sh", "sh", "-c", cmd, NULL);
+		perror("ddw_batch: execl");
+		_exit(EXIT_FAILURE);
+	}
+
+	close(to[0]);
+	close(from[1]);
+
+	*self = (struct worker){
+		.pid = pid,
+		.to = to[1],
+		.from = fdopen(from[0], "r"),
+		.job = -1,
+	};
+	if (self->from == NULL) {
+		perror("ddw_batch: fdopen");
+		close(from[0]);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+worker_stop(struct worker *self)
+{
+	if (self->to != -1)
+		close(self->to);
+	if (self->from != NULL)
+		fclose(self->from);
+	if (self->pid > 0)
+		waitpid(self->pid, NULL, 0);
+
+	self->to = -1;
+	self->from = NULL;
+	self->pid = -1;
+}
+
+static bool
+worker_give(struct worker *self, struct job *jobs, int idx)
+{
+	struct job *job = &jobs[idx];
+
+	if (dprintf(self->to, "%s\t%s\n", job->in_abs, job->out_abs) < 0) {
+		perror("ddw_batch: write");
+		return false;
+	}
+
+	job->state = JOB_RUNNING;
+	self->job = idx;
+	self->start_ns = now_ns();
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+
+static char *
+host_path(const char *prefix, const char *dir, const char *name)
+{
+	char *p;
+
+	if (asprintf(&p, "%s%s%s%s", prefix, dir, name ? "/" : "", name ?: "") < 0)
+		return NULL;
+
+	return p;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: ddw_batch [-j hosts] [-H host_cmd] [-f rate,bits,ch] [-P prefix] -o outdir chain file...\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *host_cmd = "wine ddw_host.exe";
+	const char *rawfmt = NULL;
+	const char *prefix = "Z:";
+	const char *outdir = NULL;
+	char outdir_abs[PATH_MAX];
+	long nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+
+	char *cmd;
+	struct job *jobs;
+	struct worker *workers;
+	struct pollfd *pfds;
+	int njobs, next = 0, printed = 0, running = 0, alive;
+	int failed = 0;
+	uint64_t t0;
+
+	while ((opt = getopt(argc, argv, "j:H:f:P:o:")) != -1) {
+		switch (opt) {
+		case 'j': nworkers = atol(optarg); break;
+		case 'H': host_cmd = optarg; break;
+		case 'f': rawfmt = optarg; break;
+		case 'P': prefix = optarg; break;
+		case 'o': outdir = optarg; break;
+		default: usage();
+		}
+	}
+	if (outdir == NULL || optind+2 > argc || nworkers < 1)
+		usage();
+
+	if (realpath(outdir, outdir_abs) == NULL) {
+		perror("ddw_batch: realpath");
+		return 1;
+	}
+
+	njobs = argc-optind-1;
+	nworkers = (nworkers < njobs) ? nworkers : njobs;
+
+	jobs = calloc(njobs, sizeof(*jobs));
+	workers = calloc(nworkers, sizeof(*workers));
+	pfds = calloc(nworkers, sizeof(*pfds));
+	if (jobs == NULL || workers == NULL || pfds == NULL) {
+		perror("ddw_batch: calloc");
+		return 1;
+	}
+
+	for (int i = 0; i < njobs; i++) {
+		struct job *job = &jobs[i];
+		char abs[PATH_MAX];
+		char *tmp;
+
+		job->in = argv[optind+1+i];
+		if (realpath(job->in, abs) == NULL) {
+			fprintf(stderr, "ddw_batch: %s: %s\n", job->in, strerror(errno));
+			return 1;
+		}
+		job->in_abs = host_path(prefix, abs, NULL);
+
+		tmp = strdup(job->in);
+		job->out_abs = host_path(prefix, outdir_abs, basename(tmp));
+		free(tmp);
+
+		if (job->in_abs == NULL || job->out_abs == NULL) {
+			perror("ddw_batch: asprintf");
+			return 1;
+		}
+		if (strcmp(job->in_abs, job->out_abs) == 0) {
+			fprintf(stderr, "ddw_batch: %s would be overwritten\n", job->in);
+			return 1;
+		}
+
+		// (outputs are named after just the file, two hosts could be
+		//  writing the same one)
+		for (int j = 0; j < i; j++) {
+			if (strcmp(jobs[j].out_abs, job->out_abs) == 0) {
+				fprintf(stderr, "ddw_batch: %s and %s would both be rendered to %s\n",
+				    jobs[j].in, job->in, job->out_abs);
+				return 1;
+			}
+		}
+	}
+
+	if (asprintf(&cmd, "exec %s --render-batch%s%s %s",
+	    host_cmd, rawfmt ? "=" : "", rawfmt ?: "", argv[optind]) < 0) {
+		perror("ddw_batch: asprintf");
+		return 1;
+	}
+
+	// a host dying shouldn't kill us
+	signal(SIGPIPE, SIG_IGN);
+
+	t0 = now_ns();
+
+	alive = 0;
+	for (int i = 0; i < nworkers; i++) {
+		if (!worker_start(&workers[i], cmd)) {
+			workers[i] = (struct worker){.pid = -1, .to = -1, .job = -1};
+			continue;
+		}
+		alive++;
+	}
+
+	while (printed < njobs) {
+		// hand out work
+		for (int i = 0; i < nworkers && next < njobs; i++) {
+			if (workers[i].pid == -1 || workers[i].job != -1)
+				continue;
+			if (!worker_give(&workers[i], jobs, next)) {
+				worker_stop(&workers[i]);
+				alive--;
+				continue;
+			}
+			next++;
+			running++;
+		}
+
+		// nothing left to run it on
+		if (running == 0 && alive == 0) {
+			for (int i = next; i < njobs; i++)
+				jobs[i].state = JOB_FAILED;
+			next = njobs;
+		}
+
+		// wait for any host to finish
+		if (running > 0) {
+			for (int i = 0; i < nworkers; i++) {
+				pfds[i] = (struct pollfd){
+					.fd = (workers[i].job != -1) ? fileno(workers[i].from) : -1,
+					.events = POLLIN,
+				};
+			}
+
+			if (poll(pfds, nworkers, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("ddw_batch: poll");
+				return 1;
+			}
+
+			for (int i = 0; i < nworkers; i++) {
+				struct worker *w = &workers[i];
+				char line[64];
+				struct job *job;
+
+				if (pfds[i].revents == 0)
+					continue;
+
+				job = &jobs[w->job];
+				job->ns = now_ns()-w->start_ns;
+
+				if (fgets(line, sizeof(line), w->from) != NULL) {
+					job->state = (strcmp(line, "ok\n") == 0) ? JOB_OK : JOB_FAILED;
+				} else {
+					// the host died, don't give it any more
+					fprintf(stderr, "ddw_batch: host %d exited\n", (int)w->pid);
+					job->state = JOB_FAILED;
+					worker_stop(w);
+					alive--;
+				}
+
+				w->job = -1;
+				running--;
+			}
+		}
+
+		// print whatever's done, in order
+		while (printed < njobs && jobs[printed].state >= JOB_OK) {
+			struct job *job = &jobs[printed];
+
+			printf("%s %s -> %s (%.2f s)\n",
+			    job->state == JOB_OK ? "ok" : "FAILED",
+			    job->in, job->out_abs, job->ns/1e9);
+			if (job->state != JOB_OK)
+				failed++;
+			printed++;
+		}
+		fflush(stdout);
+	}
+
+	for (int i = 0; i < nworkers; i++)
+		worker_stop(&workers[i]);
+
+	printf("%d files, %d failed, %ld hosts, %.2f s\n",
+	    njobs, failed, nworkers, (now_ns()-t0)/1e9);
+
+	for (int i = 0; i < njobs; i++) {
+		free(jobs[i].in_abs);
+		free(jobs[i].out_abs);
+	}
+	free(jobs);
+	free(workers);
+	free(pfds);
+	free(cmd);
+
+	return failed ? 1 : 0;
+}
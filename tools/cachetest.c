@@ -0,0 +1,242 @@
+//
+// ddw_cachetest: plays two tracks back to back through cache_process() the
+//  way dsp_winamp_process() does with ddw.cache_dir set, and checks that
+//  both of them got a cache file and that playing them again from there
+//  gives the same output without the host
+//
+// the host is ddw_mock_host with latency=300 by default, so the chain still
+//  holds some of the first track when the second one starts
+//
+// usage: ddw_cachetest [-H host_cmd] [-o mock_options] [-n blocks]
+//
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../plugin/child.h"
+#include "../plugin/fmt.h"
+#include "../plugin/plugin.h"
+
+#include "fakedb.h"
+
+#define TRACKS 2
+#define FRAMES 1024
+
+struct track {
+	char *out;
+	size_t outsz;
+};
+
+// -----------------------------------------------------------------------------
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: ddw_cachetest [-H host_cmd] [-o mock_options] [-n blocks]\n");
+	exit(1);
+}
+
+//
+// how many files in dir end with suffix. with `remove`, delete them
+//
+static int
+count_files(const char *dir, const char *suffix, bool remove)
+{
+	size_t suffixlen = strlen(suffix);
+	struct dirent *ent;
+	DIR *d;
+	int cnt = 0;
+
+	d = opendir(dir);
+	if (d == NULL) {
+		perror("ddw_cachetest: opendir");
+		return -1;
+	}
+
+	while ((ent = readdir(d)) != NULL) {
+		size_t len = strlen(ent->d_name);
+		char path[4096];
+
+		if (len < suffixlen || strcmp(ent->d_name+len-suffixlen, suffix) != 0)
+			continue;
+		cnt++;
+
+		if (remove) {
+			snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+			unlink(path);
+		}
+	}
+	closedir(d);
+
+	return cnt;
+}
+
+//
+// one pass over the track. its output goes to `out`
+//
+static bool
+play(struct ddw *pl,
+     int idx,
+     int blocks,
+     const ddb_waveformat_t *fmt,
+     char *data,
+     size_t datacap,
+     struct track *out)
+{
+	size_t fs = fmt_frames2bytes(fmt, 1);
+
+	fakedb_set_track(idx, (float)blocks*FRAMES/fmt->samplerate);
+
+	out->outsz = 0;
+
+	for (int i = 0; i < blocks; i++) {
+		ddb_waveformat_t f = *fmt;
+		int rv;
+
+		// different for every track, and not silence
+		for (size_t j = 0; j < fs*FRAMES; j++)
+			data[j] = (char)(idx*7+i+j+1);
+
+		rv = cache_process(&pl->host, &f, fmt, data, FRAMES, datacap);
+		if (rv < 0) {
+			fprintf(stderr, "ddw_cachetest: processing failed at block %d of track %d\n", i, idx);
+			return false;
+		}
+
+		memcpy(out->out+out->outsz, data, rv*fs);
+		out->outsz += rv*fs;
+	}
+
+	return true;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *host_cmd = "./ddw_mock_host";
+	const char *spec = "latency=300";
+	int blocks = 50;
+	int opt;
+
+	char dir[] = "/tmp/ddw_cachetest.XXXXXX";
+	struct ddw pl = {0};
+	struct track first[TRACKS] = {0}, again[TRACKS] = {0};
+	ddb_waveformat_t fmt = {
+		.bps = 16,
+		.channels = 2,
+		.samplerate = 44100,
+	};
+	size_t datacap, outcap;
+	char *data = NULL;
+	int cached;
+	int rv = 1;
+
+	while ((opt = getopt(argc, argv, "H:o:n:")) != -1) {
+		switch (opt) {
+		case 'H': host_cmd = optarg; break;
+		case 'o': spec = optarg; break;
+		case 'n': blocks = atoi(optarg); break;
+		default: usage();
+		}
+	}
+	if (optind != argc || blocks <= 0)
+		usage();
+
+	if (mkdtemp(dir) == NULL) {
+		perror("ddw_cachetest: mkdtemp");
+		return 1;
+	}
+	setenv("DDW_CACHE_DIR", dir, 1);
+
+	fakedb_init(host_cmd);
+
+	pl.dll = strdup(spec);
+	pl.max_bps = fmt.bps;
+	pl.host = CHILD_INITIALIZER(&pl);
+
+	// (reads ddw.cache_dir)
+	cache_reset(&pl.host);
+
+	datacap = fmt_frames2bytes(&fmt, FRAMES)*4;
+	outcap = fmt_frames2bytes(&fmt, FRAMES)*blocks;
+	data = malloc(datacap);
+	if (data == NULL)
+		goto oom;
+	for (int i = 0; i < TRACKS; i++) {
+		first[i].out = malloc(outcap);
+		again[i].out = malloc(outcap);
+		if (first[i].out == NULL || again[i].out == NULL)
+			goto oom;
+	}
+
+	//
+	// the first time, live and saved. a stop (dsp reset) at the end
+	//  finishes the last one
+	//
+	for (int i = 0; i < TRACKS; i++) {
+		if (!play(&pl, i, blocks, &fmt, data, datacap, &first[i]))
+			goto out;
+	}
+	cache_reset(&pl.host);
+
+	cached = count_files(dir, ".ddwr", false);
+	if (cached != TRACKS) {
+		fprintf(stderr, "ddw_cachetest: %d of %d tracks were cached\n", cached, TRACKS);
+		goto out;
+	}
+
+	//
+	// again, from the cache files. the host isn't needed for that, so it's
+	//  stopped and has to stay that way
+	//
+	child_stop(&pl.host);
+
+	for (int i = 0; i < TRACKS; i++) {
+		if (!play(&pl, i, blocks, &fmt, data, datacap, &again[i]))
+			goto out;
+
+		if (again[i].outsz != first[i].outsz ||
+		    memcmp(again[i].out, first[i].out, first[i].outsz) != 0) {
+			fprintf(stderr, "ddw_cachetest: track %d sounds different from the cache\n", i);
+			goto out;
+		}
+	}
+	if (pl.host.pid != -1) {
+		fprintf(stderr, "ddw_cachetest: the host was started for cached tracks\n");
+		goto out;
+	}
+
+	rv = 0;
+out:
+	cache_close(&pl.host);
+	child_stop(&pl.host);
+	flight_close(&pl.host);
+	child_free_buffers(&pl.host);
+
+	if (rv == 0 && fakedb_track_refs() != 0) {
+		fprintf(stderr, "ddw_cachetest: %d track references weren't given back\n", fakedb_track_refs());
+		rv = 1;
+	}
+
+	count_files(dir, ".ddwr", true);
+	count_files(dir, ".tmp", true);
+	rmdir(dir);
+
+	if (rv == 0)
+		printf("ok: %d tracks in a row with %s cached and played back\n", TRACKS, spec);
+
+	free(data);
+	for (int i = 0; i < TRACKS; i++) {
+		free(first[i].out);
+		free(again[i].out);
+	}
+	free(pl.dll);
+
+	return rv;
+oom:
+	perror("ddw_cachetest: malloc");
+	goto out;
+}
@@ -0,0 +1,155 @@
+#include "fakedb.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../plugin/plugin.h"
+
+static const char *fake_host_cmd;
+
+static DB_playItem_t fake_tracks[FAKEDB_TRACKS];
+static char fake_uris[FAKEDB_TRACKS][32];
+static float fake_durations[FAKEDB_TRACKS];
+static int fake_track = -1;
+static int fake_refs;
+
+static void
+fake_conf_lock(void)
+{
+}
+
+static const char *
+fake_conf_get_str_fast(const char *key, const char *def)
+{
+	if (strcmp(key, "ddw.host_cmd") == 0)
+		return fake_host_cmd;
+	// lets ddw_ipcbench make captures for ddw_replay
+	if (strcmp(key, "ddw.capture_dir") == 0)
+		return getenv("DDW_CAPTURE_DIR") ?: def;
+	// lets ddw_cachetest turn the cache on
+	if (strcmp(key, "ddw.cache_dir") == 0)
+		return getenv("DDW_CACHE_DIR") ?: def;
+
+	return def;
+}
+
+static int
+fake_conf_get_int(const char *key, int def)
+{
+	const char *s;
+
+	// lets ddw_ipcbench show what ddw.lock_memory does to the faults
+	if (strcmp(key, "ddw.lock_memory") == 0 && (s = getenv("DDW_LOCK_MEMORY")) != NULL)
+		return atoi(s);
+
+	return def;
+}
+
+static void
+fake_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+static void
+fake_pcm_convert(const ddb_waveformat_t *inputfmt, const char *input,
+                 const ddb_waveformat_t *outputfmt, char *output,
+                 int inputsize)
+{
+	// the tools only use formats the host can take directly
+	fprintf(stderr, "fakedb: pcm_convert() is not implemented\n");
+	abort();
+}
+
+static int
+fake_track_idx(DB_playItem_t *it)
+{
+	return (int)(it-fake_tracks);
+}
+
+static DB_playItem_t *
+fake_streamer_get_streaming_track(void)
+{
+	if (fake_track == -1)
+		return NULL;
+
+	fake_refs++;
+	return &fake_tracks[fake_track];
+}
+
+static void
+fake_pl_item_ref(DB_playItem_t *it)
+{
+	fake_refs++;
+}
+
+static void
+fake_pl_item_unref(DB_playItem_t *it)
+{
+	if (--fake_refs < 0) {
+		fprintf(stderr, "fakedb: track %d unref'd once too often\n", fake_track_idx(it));
+		abort();
+	}
+}
+
+static float
+fake_pl_get_item_duration(DB_playItem_t *it)
+{
+	return fake_durations[fake_track_idx(it)];
+}
+
+static const char *
+fake_pl_find_meta(DB_playItem_t *it, const char *key)
+{
+	if (strcmp(key, ":URI") == 0)
+		return fake_uris[fake_track_idx(it)];
+
+	return NULL;
+}
+
+void
+fakedb_set_track(int idx, float duration)
+{
+	fake_track = idx;
+	if (idx == -1)
+		return;
+
+	snprintf(fake_uris[idx], sizeof(fake_uris[idx]), "/fakedb/track%d.wav", idx);
+	fake_durations[idx] = duration;
+}
+
+int
+fakedb_track_refs(void)
+{
+	return fake_refs;
+}
+
+static DB_functions_t fake_deadbeef;
+
+void
+fakedb_init(const char *host_cmd)
+{
+	fake_host_cmd = host_cmd;
+
+	fake_deadbeef.conf_lock = fake_conf_lock;
+	fake_deadbeef.conf_unlock = fake_conf_lock;
+	fake_deadbeef.conf_get_str_fast = fake_conf_get_str_fast;
+	fake_deadbeef.conf_get_int = fake_conf_get_int;
+	fake_deadbeef.log = fake_log;
+	fake_deadbeef.pcm_convert = fake_pcm_convert;
+	fake_deadbeef.pl_lock = fake_conf_lock;
+	fake_deadbeef.pl_unlock = fake_conf_lock;
+	fake_deadbeef.streamer_get_streaming_track = fake_streamer_get_streaming_track;
+	fake_deadbeef.pl_item_ref = fake_pl_item_ref;
+	fake_deadbeef.pl_item_unref = fake_pl_item_unref;
+	fake_deadbeef.pl_get_item_duration = fake_pl_get_item_duration;
+	fake_deadbeef.pl_find_meta = fake_pl_find_meta;
+
+	deadbeef = &fake_deadbeef;
+}
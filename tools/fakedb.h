@@ -0,0 +1,23 @@
+#pragma once
+
+//
+// just enough of DB_functions_t for running the plugin's child process code
+//  outside of deadbeef
+//
+void
+fakedb_init(const char *host_cmd);
+
+//
+// what streamer_get_streaming_track() returns from now on: track idx (0 to
+//  FAKEDB_TRACKS-1) with this duration, or no track with -1
+//
+#define FAKEDB_TRACKS 8
+
+void
+fakedb_set_track(int idx, float duration);
+
+//
+// references to the tracks that haven't been given back
+//
+int
+fakedb_track_refs(void);
@@ -0,0 +1,217 @@
+//
+// ddw_ipcbench: pushes synthetic audio through child_process_samples() the
+//  same way dsp_winamp_process() does, and reports how long the round trips
+//  took
+//
+// the host is ddw_mock_host by default, so this measures the transport
+//  without wine or any dlls. any other host command works too
+//
+// usage: ddw_ipcbench [-H host_cmd] [-o mock_options] [-r rate] [-b bps]
+//                     [-c channels] [-f frames_per_block] [-n blocks] [-z]
+//
+// -z sends digital silence instead, which goes without the pcm
+//
+// DDW_LOCK_MEMORY=1 in the environment is ddw.lock_memory
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../plugin/child.h"
+#include "../plugin/fmt.h"
+#include "../plugin/plugin.h"
+
+#include "fakedb.h"
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+//
+// context switches of another process, from /proc/<pid>/status
+//
+static long
+proc_ctxt_switches(pid_t pid)
+{
+	char path[64];
+	char line[256];
+	long total = 0, v;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+	f = fopen(path, "re");
+	if (f == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "voluntary_ctxt_switches: %ld", &v) == 1 ||
+		    sscanf(line, "nonvoluntary_ctxt_switches: %ld", &v) == 1)
+			total += v;
+	}
+	fclose(f);
+
+	return total;
+}
+
+static long
+self_ctxt_switches(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+// -----------------------------------------------------------------------------
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: ddw_ipcbench [-H host_cmd] [-o mock_options] [-r rate] [-b bps] [-c channels] [-f frames_per_block] [-n blocks] [-z]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *host_cmd = "./ddw_mock_host";
+	const char *spec = "gain=1";
+	int rate = 44100, bps = 16, ch = 2;
+	int frames = 1024, blocks = 10000;
+	bool zero = false;
+	int opt;
+
+	struct ddw pl = {0};
+	ddb_waveformat_t fmt;
+	size_t datacap;
+	char *data;
+	uint64_t *lat;
+	uint64_t t0, t1;
+	long long frames_out = 0;
+	long cs_self, cs_child = -1;
+	struct rusage ru0, ru1;
+
+	while ((opt = getopt(argc, argv, "H:o:r:b:c:f:n:z")) != -1) {
+		switch (opt) {
+		case 'H': host_cmd = optarg; break;
+		case 'o': spec = optarg; break;
+		case 'r': rate = atoi(optarg); break;
+		case 'b': bps = atoi(optarg); break;
+		case 'c': ch = atoi(optarg); break;
+		case 'f': frames = atoi(optarg); break;
+		case 'n': blocks = atoi(optarg); break;
+		case 'z': zero = true; break;
+		default: usage();
+		}
+	}
+	if (optind != argc || frames <= 0 || blocks <= 0)
+		usage();
+
+	fakedb_init(host_cmd);
+
+	pl.dll = strdup(spec);
+	pl.max_bps = bps;
+	pl.host = CHILD_INITIALIZER(&pl);
+
+	fmt = (ddb_waveformat_t){
+		.bps = bps,
+		.channels = ch,
+		.samplerate = rate,
+	};
+
+	// room for 4x stretch at 32 bits like the real maxframes
+	datacap = (size_t)frames*4*(32/8)*ch;
+	data = malloc(datacap);
+	lat = calloc(blocks, sizeof(uint64_t));
+	if (data == NULL || lat == NULL) {
+		perror("ddw_ipcbench: malloc");
+		return 1;
+	}
+
+	// start the host outside of the measurement
+	if (!child_start(&pl.host)) {
+		fprintf(stderr, "ddw_ipcbench: failed to start host\n");
+		return 1;
+	}
+
+	cs_self = self_ctxt_switches();
+	getrusage(RUSAGE_SELF, &ru0);
+	t0 = now_ns();
+
+	for (int i = 0; i < blocks; i++) {
+		ddb_waveformat_t f = fmt;
+		uint64_t b0;
+		int rv;
+
+		// something that isn't silence, unless it should be
+		for (size_t j = 0; j < fmt_frames2bytes(&fmt, frames); j++)
+			data[j] = (zero) ? 0 : (char)(i+j);
+
+		b0 = now_ns();
+		rv = child_process_samples(&pl.host, &f, &fmt, data, frames, datacap);
+		lat[i] = now_ns()-b0;
+
+		if (rv < 0) {
+			fprintf(stderr, "ddw_ipcbench: processing failed at block %d\n", i);
+			return 1;
+		}
+		frames_out += rv;
+	}
+
+	t1 = now_ns();
+	getrusage(RUSAGE_SELF, &ru1);
+	cs_self = self_ctxt_switches()-cs_self;
+	if (pl.host.pid != -1)
+		cs_child = proc_ctxt_switches(pl.host.pid);
+
+	child_stop(&pl.host);
+	flight_close(&pl.host);
+	child_free_buffers(&pl.host);
+
+	qsort(lat, blocks, sizeof(uint64_t), cmp_u64);
+
+	printf("host: %s %s\n", host_cmd, spec);
+	printf("format: %d Hz, %d bit, %d ch, %d frames/block, %d blocks\n",
+	    rate, bps, ch, frames, blocks);
+	printf("round trip: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+	    lat[blocks*50/100]/1000.0,
+	    lat[blocks*90/100]/1000.0,
+	    lat[blocks*99/100]/1000.0,
+	    lat[blocks-1]/1000.0);
+	printf("throughput: %.0f frames/s in, %.0f frames/s out (%.1fx real time)\n",
+	    (double)frames*blocks/((t1-t0)/1e9),
+	    (double)frames_out/((t1-t0)/1e9),
+	    (double)frames*blocks/rate/((t1-t0)/1e9));
+	printf("context switches per block: %.2f self", (double)cs_self/blocks);
+	if (cs_child >= 0)
+		printf(", %.2f host", (double)cs_child/blocks);
+	printf("\n");
+	printf("page faults per block: %.3f minor, %.3f major\n",
+	    (double)(ru1.ru_minflt-ru0.ru_minflt)/blocks,
+	    (double)(ru1.ru_majflt-ru0.ru_majflt)/blocks);
+
+	free(data);
+	free(lat);
+	free(pl.dll);
+
+	return 0;
+}
@@ -0,0 +1,330 @@
+//
+// ddw_mock_host: a native stand-in for ddw_host.exe
+//
+// speaks the same stdin/stdout protocol (plugin/ddw.h) but instead of
+//  running winamp dlls it applies a configurable fake "chain", so the
+//  transport can be measured without wine
+//
+// usage: ddw_mock_host [option[:option...]]
+//
+// options:
+//   gain=X        multiply samples by X
+//   latency=N     delay the output by N frames (output size = input size)
+//   stretch=X     output X times as many frames as were input
+//   cost=N        burn N ns of cpu time per frame
+//   inactive=1    say that no dlls run at this format (the dsp should stop
+//                 sending blocks after the first)
+//
+// with no options it echoes the input back (identity)
+//
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../plugin/ddw.h"
+#include "../plugin/misc.h"
+
+static struct mockopts {
+	double gain;
+	unsigned int latency;
+	double stretch;
+	unsigned int cost_ns;
+	int inactive;
+} opts = {
+	.gain = 1.0,
+	.latency = 0,
+	.stretch = 1.0,
+	.cost_ns = 0,
+};
+
+// -----------------------------------------------------------------------------
+
+static bool
+read_all(int fd, void *p_, size_t sz)
+{
+	char *p = p_;
+
+	while (sz > 0) {
+		ssize_t rv = read(fd, p, sz);
+		if (rv == -1 && errno == EINTR)
+			continue;
+		if (rv <= 0)
+			return false;
+		p += rv;
+		sz -= rv;
+	}
+
+	return true;
+}
+
+static bool
+write_all(int fd, const void *p_, size_t sz)
+{
+	const char *p = p_;
+
+	while (sz > 0) {
+		ssize_t rv = write(fd, p, sz);
+		if (rv == -1 && errno == EINTR)
+			continue;
+		if (rv <= 0)
+			return false;
+		p += rv;
+		sz -= rv;
+	}
+
+	return true;
+}
+
+static bool
+is_zero(const unsigned char *p, size_t sz)
+{
+	// (every byte is the same as the one before it, and the first is 0)
+	return sz == 0 || (p[0] == 0 && memcmp(p, p+1, sz-1) == 0);
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// -----------------------------------------------------------------------------
+
+//
+// samples are little-endian signed integers of 8-32 bits
+// these work with them as int32 with the value in the high bits
+//
+
+static int32_t
+sample_get(const unsigned char *p, int bytes)
+{
+	uint32_t v = 0;
+
+	for (int i = 0; i < bytes; i++)
+		v |= (uint32_t)p[i] << (8*(4-bytes+i));
+
+	return (int32_t)v;
+}
+
+static void
+sample_set(unsigned char *p, int bytes, int32_t v)
+{
+	for (int i = 0; i < bytes; i++)
+		p[i] = (uint32_t)v >> (8*(4-bytes+i));
+}
+
+static void
+apply_gain(unsigned char *p, size_t sz, int bytes)
+{
+	for (size_t i = 0; i < sz; i += bytes) {
+		double v = (double)sample_get(p+i, bytes)*opts.gain;
+
+		if (v > INT32_MAX) v = INT32_MAX;
+		if (v < INT32_MIN) v = INT32_MIN;
+
+		sample_set(p+i, bytes, (int32_t)v);
+	}
+}
+
+static void
+burn_cpu(unsigned int frames)
+{
+	uint64_t until = now_ns() + (uint64_t)frames*opts.cost_ns;
+
+	while (now_ns() < until)
+		continue;
+}
+
+// -----------------------------------------------------------------------------
+
+static bool
+parse_opts(const char *arg)
+{
+	char *s = strdup(arg);
+	char *save = NULL;
+
+	for (char *tok = strtok_r(s, ":", &save); tok != NULL; tok = strtok_r(NULL, ":", &save)) {
+		char *eq = strchr(tok, '=');
+		const char *val;
+
+		if (eq == NULL) {
+			fprintf(stderr, "ddw_mock_host: option \"%s\" needs a value\n", tok);
+			goto err;
+		}
+		*eq = '\0';
+		val = eq+1;
+
+		if (strcmp(tok, "gain") == 0)
+			opts.gain = atof(val);
+		else if (strcmp(tok, "latency") == 0)
+			opts.latency = atoi(val);
+		else if (strcmp(tok, "stretch") == 0)
+			opts.stretch = atof(val);
+		else if (strcmp(tok, "cost") == 0)
+			opts.cost_ns = atoi(val);
+		else if (strcmp(tok, "inactive") == 0)
+			opts.inactive = atoi(val);
+		else {
+			fprintf(stderr, "ddw_mock_host: unrecognized option \"%s\"\n", tok);
+			goto err;
+		}
+	}
+
+	if (opts.stretch <= 0.0) {
+		fprintf(stderr, "ddw_mock_host: stretch must be positive\n");
+		goto err;
+	}
+
+	free(s);
+	return true;
+err:
+	free(s);
+	return false;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned char *in = NULL, *out = NULL;
+	size_t incap = 0, outcap = 0;
+
+	// the delay line: frames waiting to be output
+	unsigned char *delay = NULL;
+	size_t delaysz = 0, delaycap = 0;
+	uint8_t lastbps = 0, lastch = 0;
+
+	// fractional output frames carried over between blocks when stretching
+	double stretch_acc = 0.0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!parse_opts(argv[i]))
+			return 1;
+	}
+
+	for (;;) {
+		struct processing_request req;
+		struct processing_response res;
+		size_t fs;
+		unsigned int frames, outframes;
+
+		if (!read_all(STDIN_FILENO, &req, sizeof(req)))
+			break;
+
+		if (!PRREQ_IS_VALID(req)) {
+			fprintf(stderr, "ddw_mock_host: invalid request\n");
+			return 1;
+		}
+
+		// reset/flush: the delay line goes silent either way, there's
+		//  no other state to flush
+		if (req.command != DDW_CMD_PROCESS && req.command != DDW_CMD_SILENCE) {
+			if (lastbps != 0)
+				memset(delay, 0, delaysz);
+			stretch_acc = 0.0;
+
+			res = (struct processing_response){
+				.latency_frames = opts.latency,
+			};
+			if (!write_all(STDOUT_FILENO, &res, sizeof(res))) {
+				perror("ddw_mock_host: write");
+				return 1;
+			}
+			continue;
+		}
+
+		fs = (req.bitspersample/8)*req.channels;
+		frames = req.buffer_size/fs;
+
+		if (incap < req.buffer_size) {
+			incap = req.buffer_size;
+			in = realloc(in, incap);
+		}
+		if (req.command == DDW_CMD_SILENCE) {
+			memset(in, 0, req.buffer_size);
+		} else if (!read_all(STDIN_FILENO, in, req.buffer_size)) {
+			fprintf(stderr, "ddw_mock_host: read: unexpected EOF\n");
+			return 1;
+		}
+
+		// new format: start over with a silent delay line
+		if (req.bitspersample != lastbps || req.channels != lastch) {
+			lastbps = req.bitspersample;
+			lastch = req.channels;
+			delaysz = opts.latency*fs;
+			if (delaycap < delaysz+req.buffer_size) {
+				delaycap = delaysz+req.buffer_size;
+				delay = realloc(delay, delaycap);
+			}
+			memset(delay, 0, delaysz);
+			stretch_acc = 0.0;
+		}
+
+		//
+		// latency: append to the delay line, take the same amount from
+		//  the front
+		//
+		if (opts.latency != 0) {
+			if (delaycap < delaysz+req.buffer_size) {
+				delaycap = delaysz+req.buffer_size;
+				delay = realloc(delay, delaycap);
+			}
+			memcpy(delay+delaysz, in, req.buffer_size);
+			memcpy(in, delay, req.buffer_size);
+			memmove(delay, delay+req.buffer_size, delaysz);
+		}
+
+		if (opts.gain != 1.0)
+			apply_gain(in, req.buffer_size, req.bitspersample/8);
+
+		//
+		// stretch: nearest-neighbour resampling to the new length
+		//
+		stretch_acc += frames*opts.stretch;
+		outframes = (unsigned int)stretch_acc;
+		stretch_acc -= outframes;
+
+		if (outcap < outframes*fs) {
+			outcap = outframes*fs;
+			out = realloc(out, outcap);
+		}
+		if (outframes == frames) {
+			memcpy(out, in, req.buffer_size);
+		} else {
+			for (unsigned int i = 0; i < outframes; i++) {
+				unsigned int src = (unsigned int)((uint64_t)i*frames/outframes);
+				memcpy(out+i*fs, in+src*fs, fs);
+			}
+		}
+
+		if (opts.cost_ns != 0)
+			burn_cpu(frames);
+
+		res = (struct processing_response){
+			.buffer_size = outframes*fs,
+			.latency_frames = opts.latency,
+			.silent = (req.command == DDW_CMD_SILENCE && is_zero(out, outframes*fs)),
+			.inactive = (opts.inactive != 0),
+		};
+		if (!write_all(STDOUT_FILENO, &res, sizeof(res)) ||
+		    (!res.silent && !write_all(STDOUT_FILENO, out, res.buffer_size))) {
+			perror("ddw_mock_host: write");
+			return 1;
+		}
+	}
+
+	free(in);
+	free(out);
+	free(delay);
+
+	return 0;
+}
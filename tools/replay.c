@@ -0,0 +1,237 @@
+//
+// ddw_replay: plays a capture file (plugin/capturedata.h) back to a host
+//  through child_process_samples(), and reports how long each block took
+//
+// by default the blocks are sent as fast as the host takes them. with -p
+//  they're sent at the times they were captured, like deadbeef would
+//
+// the host is ddw_mock_host unless -H is given. with -H the dll argument
+//  stored in the capture is used, unless -o overrides it
+//
+// usage: ddw_replay [-H host_cmd] [-o dll_arg] [-p] capture.ddwc
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../plugin/capturedata.h"
+#include "../plugin/child.h"
+#include "../plugin/fmt.h"
+#include "../plugin/misc.h"
+#include "../plugin/plugin.h"
+
+#include "fakedb.h"
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void
+sleep_until(uint64_t t)
+{
+	struct timespec ts = {
+		.tv_sec = t/1000000000,
+		.tv_nsec = t%1000000000,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		continue;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+// -----------------------------------------------------------------------------
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: ddw_replay [-H host_cmd] [-o dll_arg] [-p] capture.ddwc\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *host_cmd = NULL;
+	const char *spec = NULL;
+	bool paced = false;
+	int opt;
+
+	FILE *f;
+	struct capture_header hdr;
+	struct capture_rec rec;
+	struct ddw pl = {0};
+
+	char *data = NULL;
+	size_t datacap = 0;
+	uint64_t *lat = NULL;
+	size_t nblocks = 0, latcap = 0;
+	size_t slow = 0, resets = 0;
+	long long frames_in = 0, frames_out = 0;
+	uint64_t t0, t1;
+
+	while ((opt = getopt(argc, argv, "H:o:p")) != -1) {
+		switch (opt) {
+		case 'H': host_cmd = optarg; break;
+		case 'o': spec = optarg; break;
+		case 'p': paced = true; break;
+		default: usage();
+		}
+	}
+	if (optind != argc-1)
+		usage();
+
+	f = fopen(argv[optind], "rb");
+	if (f == NULL) {
+		perror("ddw_replay: fopen");
+		return 1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, CAPTURE_MAGIC, sizeof(hdr.magic)) != 0) {
+		fprintf(stderr, "ddw_replay: %s is not a capture file\n", argv[optind]);
+		return 1;
+	}
+	hdr.dll[sizeof(hdr.dll)-1] = '\0';
+
+	if (spec == NULL)
+		spec = (host_cmd != NULL) ? hdr.dll : "gain=1";
+	if (host_cmd == NULL)
+		host_cmd = "./ddw_mock_host";
+
+	fakedb_init(host_cmd);
+
+	pl.dll = strdup(spec);
+	pl.max_bps = 32;
+	pl.host = CHILD_INITIALIZER(&pl);
+
+	// start the host outside of the measurement
+	if (!child_start(&pl.host)) {
+		fprintf(stderr, "ddw_replay: failed to start host\n");
+		return 1;
+	}
+
+	t0 = now_ns();
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		ddb_waveformat_t fmt, nextfmt;
+		int frames;
+		uint64_t b0;
+		int rv;
+
+		if (!PRREQ_IS_VALID(rec.req)) {
+			fprintf(stderr, "ddw_replay: invalid request in block %zu\n", nblocks);
+			return 1;
+		}
+
+		// resets go to the host as they are, they're not blocks
+		if (rec.req.command != DDW_CMD_PROCESS && rec.req.command != DDW_CMD_SILENCE) {
+			if (paced)
+				sleep_until(t0+rec.time_ns);
+			if (!child_send_command(&pl.host, rec.req.command, rec.req.flush_ms)) {
+				fprintf(stderr, "ddw_replay: reset failed after block %zu\n", nblocks);
+				return 1;
+			}
+			resets++;
+			continue;
+		}
+
+		fmt = (ddb_waveformat_t){
+			.bps = rec.req.bitspersample,
+			.channels = rec.req.channels,
+			.samplerate = rec.req.samplerate,
+		};
+		nextfmt = fmt;
+		frames = fmt_bytes2frames(&fmt, rec.req.buffer_size);
+
+		// room for 4x stretch like the real maxframes
+		if (datacap < rec.req.buffer_size*4) {
+			datacap = rec.req.buffer_size*4;
+			data = realloc(data, datacap);
+		}
+		if (nblocks == latcap) {
+			latcap = latcap ? latcap*2 : 1024;
+			lat = realloc(lat, latcap*sizeof(*lat));
+		}
+		if (data == NULL || lat == NULL) {
+			perror("ddw_replay: realloc");
+			return 1;
+		}
+
+		// (child_process_samples() sees that it's silence again)
+		if (rec.req.command == DDW_CMD_SILENCE) {
+			memset(data, 0, rec.req.buffer_size);
+		} else if (fread(data, 1, rec.req.buffer_size, f) != rec.req.buffer_size) {
+			fprintf(stderr, "ddw_replay: capture ends in the middle of block %zu\n", nblocks);
+			break;
+		}
+
+		if (paced)
+			sleep_until(t0+rec.time_ns);
+
+		b0 = now_ns();
+		rv = child_process_samples(&pl.host, &fmt, &nextfmt, data, frames, datacap);
+		lat[nblocks] = now_ns()-b0;
+
+		if (rv < 0) {
+			fprintf(stderr, "ddw_replay: processing failed at block %zu\n", nblocks);
+			return 1;
+		}
+
+		if (lat[nblocks] > (uint64_t)frames*1000000000/fmt.samplerate)
+			slow++;
+
+		frames_in += frames;
+		frames_out += rv;
+		nblocks++;
+	}
+
+	t1 = now_ns();
+
+	child_stop(&pl.host);
+	flight_close(&pl.host);
+	child_free_buffers(&pl.host);
+	fclose(f);
+
+	if (nblocks == 0) {
+		fprintf(stderr, "ddw_replay: no blocks in capture\n");
+		return 1;
+	}
+
+	qsort(lat, nblocks, sizeof(uint64_t), cmp_u64);
+
+	printf("host: %s %s\n", host_cmd, spec);
+	printf("capture: %s (dll \"%s\"), %zu blocks, %lld frames in, %lld frames out\n",
+	    argv[optind], hdr.dll, nblocks, frames_in, frames_out);
+	printf("mode: %s, took %.3f s\n",
+	    paced ? "paced" : "as fast as possible",
+	    (t1-t0)/1e9);
+	printf("round trip: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+	    lat[nblocks*50/100]/1000.0,
+	    lat[nblocks*90/100]/1000.0,
+	    lat[nblocks*99/100]/1000.0,
+	    lat[nblocks-1]/1000.0);
+	printf("blocks slower than real time: %zu\n", slow);
+	if (resets != 0)
+		printf("resets: %zu\n", resets);
+
+	free(data);
+	free(lat);
+	free(pl.dll);
+
+	return 0;
+}